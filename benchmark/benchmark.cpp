@@ -0,0 +1,283 @@
+// Throughput and memory benchmarks on standard symbolic regression problems.
+//
+//   g++ -std=c++11 -O3 -march=native -DNDEBUG -pthread -I../include benchmark.cpp -o benchmark
+//   ./benchmark [generations] [max_threads]
+//
+// For each problem, population size and data set size it runs the given
+// number of generations (10 by default) and reports:
+//
+//   GPops      tree nodes evaluated per second of evaluation, over all rows,
+//              in billions
+//   p50/p90/p99 latency of next_generation() in milliseconds
+//   B/ind      bytes of tree nodes in use per individual
+//   allocs/gen operator new calls per generation, node allocations included
+//
+// It then times evaluate() on one problem for 1, 2, 4, ... threads up to
+// max_threads (the hardware concurrency by default), and the evaluation
+// back-ends on the same random trees.
+
+#include <gene.hpp>
+
+#include "problems.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+    std::atomic<std::size_t> allocation_count(0);
+
+}
+
+// counts every allocation; GCC cannot tell that these replace the global pair
+#if defined __GNUC__ && !defined __clang__ && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t const bytes)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if(void* const p = std::malloc(bytes ? bytes : 1)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* const p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* const p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace benchmark {
+
+    typedef std::chrono::steady_clock clock_type;
+
+    inline double seconds_since(clock_type::time_point const start)
+    {
+        return std::chrono::duration<double>(clock_type::now() - start).count();
+    }
+
+    inline double percentile(std::vector<double> values, double const p)
+    {
+        if(values.empty()){
+            return 0;
+        }
+        std::sort(values.begin(), values.end());
+        return values[static_cast<std::size_t>(p * static_cast<double>(values.size() - 1) + 0.5)];
+    }
+
+    template<class Population>
+    double mean_size(Population const& pop)
+    {
+        double nodes = 0;
+        for(std::size_t i = 0; i < pop.size(); ++i){
+            for(auto const& t : pop[i].get_trees()){
+                nodes += static_cast<double>(t.size());
+            }
+        }
+        return pop.size() == 0 ? 0 : nodes / static_cast<double>(pop.size());
+    }
+
+    inline void print_header()
+    {
+        std::printf("%-14s %7s %8s %12s %8s %8s %8s %10s %8s %10s\n",
+                    "problem", "pop", "rows", "best", "GPops", "p50", "p90", "p99", "B/ind", "allocs/gen");
+    }
+
+    template<std::size_t InputSize>
+    void run(problem<InputSize> const& p, std::size_t const population_size,
+             std::size_t const rows, std::size_t const generations)
+    {
+        auto const data = training_data(p, rows);
+        gene::population<double, InputSize, 1> pop(population_size);
+        pop.set_training_data(data);
+        pop.evaluate();
+
+        std::vector<double> latencies;
+        double node_evaluations = 0;
+        double evaluation_time = 0;
+        pop.set_metrics_callback([&](gene::metrics::generation_metrics const& m){
+            node_evaluations += static_cast<double>(m.nodes_evaluated);
+            evaluation_time += m.evaluation_seconds;
+        });
+        auto const nodes_before = gene::memory::thread_pools_statistics();
+        std::size_t const allocations_before = allocation_count.load();
+        for(std::size_t g = 0; g < generations; ++g){
+            auto const start = clock_type::now();
+            pop.next_generation();
+            double const elapsed = seconds_since(start);
+            latencies.push_back(elapsed * 1e3);
+        }
+        pop.set_metrics_callback(nullptr);
+        std::size_t const allocations = allocation_count.load() - allocations_before;
+        auto const nodes_after = gene::memory::thread_pools_statistics();
+
+        std::printf("%-14s %7zu %8zu %12.6g %8.3f %8.2f %8.2f %10.2f %8.0f %10.0f\n",
+                    p.name.c_str(), population_size, rows, pop.fitness(),
+                    evaluation_time > 0 ? node_evaluations / evaluation_time * 1e-9 : 0.0,
+                    percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99),
+                    static_cast<double>(nodes_after.bytes_in_use) / static_cast<double>(population_size),
+                    static_cast<double>(allocations + nodes_after.allocations - nodes_before.allocations)
+                        / static_cast<double>(std::max<std::size_t>(generations, 1)));
+    }
+
+    // evaluate() on every individual with 1, 2, 4, ... threads
+    inline void thread_scaling(std::size_t const max_threads)
+    {
+        auto const p = bivariate_problems().back();
+        std::size_t const rows = 100000;
+        gene::population<double, 2, 1> pop(1000);
+        pop.set_training_data(training_data(p, rows));
+        auto const inputs = pop.training_inputs();
+        auto const outputs = pop.training_outputs();
+        double const nodes = mean_size(pop) * static_cast<double>(pop.size()) * static_cast<double>(rows);
+
+        std::printf("\nthread scaling: %s, %zu individuals, %zu rows\n", p.name.c_str(), pop.size(), rows);
+        std::printf("%8s %10s %8s %8s\n", "threads", "ms", "GPops", "speedup");
+        double single = 0;
+        for(std::size_t threads = 1; threads <= max_threads; threads *= 2){
+            pop.set_thread_pool(std::make_shared<gene::thread_pool>(threads));
+            // new training columns make every fitness stale
+            pop.set_training_columns(inputs, outputs);
+            auto const start = clock_type::now();
+            pop.evaluate();
+            double const elapsed = seconds_since(start);
+            if(threads == 1){
+                single = elapsed;
+            }
+            std::printf("%8zu %10.2f %8.3f %8.2f\n", threads, elapsed * 1e3, nodes / elapsed * 1e-9, single / elapsed);
+        }
+    }
+
+    // the same random trees over the same rows with each evaluation back-end
+    inline void backends()
+    {
+        typedef gene::tree::tree<double, gene::random_term::default_random_term<double>> tree_type;
+        std::size_t const rows = 10000;
+        std::size_t const count = 200;
+        auto const p = bivariate_problems().back();
+        gene::population<double, 2, 1> pop(0);
+        pop.set_training_data(training_data(p, rows));
+        auto const& inputs = pop.training_inputs();
+        auto const ptrs = inputs.pointers();
+
+        std::vector<tree_type> trees;
+        double nodes = 0;
+        for(std::size_t i = 0; i < count; ++i){
+            trees.push_back(gene::tree::generate_random<double, 2, gene::random_term::default_random_term<double>>(gene::config::random_tree_depth));
+            nodes += static_cast<double>(trees.back().size()) * static_cast<double>(rows);
+        }
+        std::vector<double> out(rows);
+        double checksum = 0;
+        auto report = [&](char const* name, clock_type::time_point const start){
+            double const elapsed = seconds_since(start);
+            std::printf("%-16s %10.2f %8.3f\n", name, elapsed * 1e3, nodes / elapsed * 1e-9);
+        };
+
+        std::printf("\nback-ends: %zu random trees, %zu rows\n", count, rows);
+        std::printf("%-16s %10s %8s\n", "back-end", "ms", "GPops");
+        {
+            auto const start = clock_type::now();
+            for(auto const& t : trees){
+                for(std::size_t r = 0; r < rows; ++r){
+                    out[r] = t.value(std::array<double, 2>{{inputs.column(0)[r], inputs.column(1)[r]}});
+                }
+                checksum += out[0];
+            }
+            report("tree walk", start);
+        }
+        {
+            std::vector<gene::bytecode::program<double>> programs;
+            for(auto const& t : trees){
+                programs.push_back(gene::bytecode::compile(t));
+            }
+            auto const start = clock_type::now();
+            for(auto const& prog : programs){
+                prog(ptrs.data(), rows, out.data());
+                checksum += out[0];
+            }
+            report("bytecode", start);
+        }
+        {
+            std::vector<gene::tree::flat_tree<double, gene::random_term::default_random_term<double>>> flats;
+            for(auto const& t : trees){
+                flats.push_back(gene::tree::flatten(t));
+            }
+            gene::batch::evaluator<double> eval;
+            auto const start = clock_type::now();
+            for(auto const& f : flats){
+                eval(f, ptrs.data(), rows, out.data());
+                checksum += out[0];
+            }
+            report("batch", start);
+        }
+        {
+            std::vector<gene::tree::flat_tree<double, gene::random_term::default_random_term<double>>> flats;
+            for(auto const& t : trees){
+                flats.push_back(gene::tree::flatten(t));
+            }
+            gene::batch::subtree_cache<double> cache(std::size_t(256) << 20);
+            gene::batch::cached_evaluator<double> cached(cache);
+            auto start = clock_type::now();
+            for(auto const& f : flats){
+                cached(f, ptrs.data(), rows, out.data());
+                checksum += out[0];
+            }
+            report("batch + cache", start);
+            // subtrees are stored on their second miss, then reused
+            for(auto const& f : flats){
+                cached(f, ptrs.data(), rows, out.data());
+            }
+            start = clock_type::now();
+            for(auto const& f : flats){
+                cached(f, ptrs.data(), rows, out.data());
+                checksum += out[0];
+            }
+            report("batch + warm cache", start);
+        }
+        // keeps the evaluations from being optimized away
+        if(checksum == 42.0){
+            std::printf("\n");
+        }
+    }
+
+} // namespace benchmark
+
+int main(int argc, char** argv)
+{
+    std::size_t const generations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10;
+    std::size_t max_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+    max_threads = std::max<std::size_t>(max_threads, 1);
+
+    std::size_t const population_sizes[] = {500, 2000};
+    std::size_t const row_counts[] = {1000, 20000};
+
+    gene::random::seed(1);
+    benchmark::print_header();
+    for(auto const population_size : population_sizes){
+        for(auto const rows : row_counts){
+            for(auto const& p : benchmark::univariate_problems()){
+                benchmark::run(p, population_size, rows, generations);
+            }
+            for(auto const& p : benchmark::bivariate_problems()){
+                benchmark::run(p, population_size, rows, generations);
+            }
+        }
+    }
+    benchmark::thread_scaling(max_threads);
+    benchmark::backends();
+    return 0;
+}
@@ -0,0 +1,135 @@
+#if !defined GENE_BENCHMARK_PROBLEMS_HPP_INCLUDED
+#define      GENE_BENCHMARK_PROBLEMS_HPP_INCLUDED
+
+// Standard symbolic regression problems, after McDermott et al.,
+// "Genetic Programming Needs Better Benchmarks" (GECCO 2012).
+// Training points are drawn uniformly from each problem's range with a
+// fixed seed, so every run sees the same data.
+
+#include <array>
+#include <vector>
+#include <tuple>
+#include <string>
+#include <random>
+#include <cmath>
+#include <cstddef>
+
+namespace benchmark {
+
+    template<std::size_t InputSize>
+    struct problem{
+        std::string name;
+        double low;
+        double high;
+        double (*target)(std::array<double, InputSize> const&);
+    };
+
+    namespace impl {
+
+        inline double koza_quartic(std::array<double, 1> const& v)
+        {
+            double const x = v[0];
+            return x * x * x * x + x * x * x + x * x + x;
+        }
+
+        inline double nguyen_1(std::array<double, 1> const& v)
+        {
+            double const x = v[0];
+            return x * x * x + x * x + x;
+        }
+
+        inline double nguyen_5(std::array<double, 1> const& v)
+        {
+            double const x = v[0];
+            return std::sin(x * x) * std::cos(x) - 1;
+        }
+
+        inline double nguyen_7(std::array<double, 1> const& v)
+        {
+            double const x = v[0];
+            return std::log(x + 1) + std::log(x * x + 1);
+        }
+
+        inline double keijzer_4(std::array<double, 1> const& v)
+        {
+            double const x = v[0];
+            double const s = std::sin(x);
+            return x * x * x * std::exp(-x) * std::cos(x) * s * (s * s * std::cos(x) - 1);
+        }
+
+        inline double nguyen_10(std::array<double, 2> const& v)
+        {
+            return 2 * std::sin(v[0]) * std::cos(v[1]);
+        }
+
+        inline double keijzer_11(std::array<double, 2> const& v)
+        {
+            return v[0] * v[1] + std::sin((v[0] - 1) * (v[1] - 1));
+        }
+
+        inline double pagie_1(std::array<double, 2> const& v)
+        {
+            return 1 / (1 + std::pow(v[0], -4)) + 1 / (1 + std::pow(v[1], -4));
+        }
+
+    } // namespace impl
+
+    inline std::vector<problem<1>> univariate_problems()
+    {
+        return {
+            {"koza-quartic", -1, 1, impl::koza_quartic},
+            {"nguyen-1", -1, 1, impl::nguyen_1},
+            {"nguyen-5", -1, 1, impl::nguyen_5},
+            {"nguyen-7", 0, 2, impl::nguyen_7},
+            {"keijzer-4", 0, 10, impl::keijzer_4},
+        };
+    }
+
+    inline std::vector<problem<2>> bivariate_problems()
+    {
+        return {
+            {"nguyen-10", 0, 1, impl::nguyen_10},
+            {"keijzer-11", -3, 3, impl::keijzer_11},
+            {"pagie-1", -5, 5, impl::pagie_1},
+        };
+    }
+
+    namespace impl {
+
+        template<std::size_t N, std::size_t... Idx>
+        struct row_maker : row_maker<N - 1, N - 1, Idx...> {};
+
+        template<std::size_t... Idx>
+        struct row_maker<0, Idx...>{
+            template<std::size_t InputSize>
+            static auto make(std::array<double, InputSize> const& x, double const y)
+                -> decltype(std::make_tuple(x[Idx]..., y))
+            {
+                return std::make_tuple(x[Idx]..., y);
+            }
+        };
+
+    } // namespace impl
+
+    // rows training points of p as tuples (x0, ..., y) for population::set_training_data
+    template<std::size_t InputSize>
+    auto training_data(problem<InputSize> const& p, std::size_t const rows)
+        -> std::vector<decltype(impl::row_maker<InputSize>::make(std::array<double, InputSize>(), 0.0))>
+    {
+        std::mt19937 engine(12345);
+        std::uniform_real_distribution<double> dist(p.low, p.high);
+        std::vector<decltype(impl::row_maker<InputSize>::make(std::array<double, InputSize>(), 0.0))> retval;
+        retval.reserve(rows);
+        for(std::size_t r = 0; r < rows; ++r){
+            std::array<double, InputSize> x;
+            for(auto &v : x){
+                v = dist(engine);
+            }
+            retval.push_back(impl::row_maker<InputSize>::make(x, p.target(x)));
+        }
+        return retval;
+    }
+
+} // namespace benchmark
+
+#endif    // GENE_BENCHMARK_PROBLEMS_HPP_INCLUDED
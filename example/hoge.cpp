@@ -1,15 +1,16 @@
+// g++ -std=c++11 -O2 -pthread -I../include hoge.cpp -o hoge
+
 #include <iostream>
 #include <random>
 #include <vector>
 #include <tuple>
 #include <array>
 #include <string>
+#include <cmath>
 
-#include <boost/detail/lightweight_test.hpp>
-
-#include "../genep/genep.hpp"
+#include <gene.hpp>
 
-typedef std::pair<std::tuple<double, double>, std::tuple<double> > data_type;
+typedef std::tuple<double, double, double> data_type;
 
 inline
 double secret_expression(double param1, double param2)
@@ -26,22 +27,21 @@ std::vector<data_type> get_1000_data(Engine& engine)
     for(int i=0; i<1000; ++i){
         auto x1 = dst(engine);
         auto x2 = dst(engine);
-        auto input = std::make_tuple(x1, x2);
-        auto output = std::make_tuple(secret_expression(x1, x2));
-        data.emplace_back(input, output);
+        data.emplace_back(x1, x2, secret_expression(x1, x2));
     }
     return data;
 }
 
 template<class Result, class Engine>
-void validate(Result const& result, Engine& engine)
+double validate(Result const& result, Engine& engine)
 {
     auto validate_data = get_1000_data(engine);
+    double error = 0;
     for(auto const& validater : validate_data){
-        // GP's output is correct or not
-        BOOST_TEST_EQ( validater.second[0],
-                       result.value(validater.first[0], validater.first[1]) );
+        auto const output = result.value({{std::get<0>(validater), std::get<1>(validater)}});
+        error += std::abs(output[0] - std::get<2>(validater));
     }
+    return error / validate_data.size();
 }
 
 int main()
@@ -49,14 +49,16 @@ int main()
     std::random_device device;
     std::mt19937 engine(device());
 
-    genep::population< genep::input<double, double>,
-                       genep::output<double> > population;
-    population.set_training_data(get_1000_data());
-    while(population.fitness() > 10e-7){
+    gene::population<double, 2, 1> population;
+    population.set_training_data(get_1000_data(engine));
+    while(population.fitness() > 10e-7 && population.current_generation() < 100){
         population.next_generation();
     }
-    auto result = population.most_suitable_individual()[0];
-    std::cout << "f(x0) = " << result;
+    auto const& result = population.most_suitable_individual();
+    std::cout << "generation " << population.current_generation()
+              << ", fitness " << result.fitness << '\n'
+              << result.expressions() << '\n'
+              << "mean absolute error on new data: " << validate(result, engine) << std::endl;
 
     return 0;
 }
@@ -2,12 +2,35 @@
 #define      GENE_GENE_HPP_INCLUDED
 
 #include "gene/config.hpp"
+#include "gene/random.hpp"
 #include "gene/util.hpp"
+#include "gene/memory.hpp"
+#include "gene/simd.hpp"
+#include "gene/hash.hpp"
 #include "gene/node.hpp"
+#include "gene/interval.hpp"
 #include "gene/operators.hpp"
 #include "gene/random_term.hpp"
+#include "gene/hashcons.hpp"
 #include "gene/tree.hpp"
+#include "gene/simplify.hpp"
+#include "gene/range_analysis.hpp"
+#include "gene/flat_tree.hpp"
+#include "gene/batch.hpp"
+#include "gene/eval_cache.hpp"
+#include "gene/bytecode.hpp"
+#include "gene/autodiff.hpp"
 #include "gene/individual.hpp"
+#include "gene/fitness_table.hpp"
+#include "gene/thread_pool.hpp"
+#include "gene/metrics.hpp"
+#include "gene/spsc_queue.hpp"
 #include "gene/population.hpp"
+#include "gene/island_model.hpp"
+#include "gene/mapped_file.hpp"
+#include "gene/dataset.hpp"
+#include "gene/serialize.hpp"
+#include "gene/codegen.hpp"
+#include "gene/jit.hpp"
 
 #endif    // GENE_GENE_HPP_INCLUDED
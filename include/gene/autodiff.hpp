@@ -0,0 +1,311 @@
+#if !defined GENE_AUTODIFF_HPP_INCLUDED
+#define      GENE_AUTODIFF_HPP_INCLUDED
+
+#include "config.hpp"
+#include "node.hpp"
+#include "operators.hpp"
+#include "flat_tree.hpp"
+#include "batch.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+
+namespace gene {
+
+namespace autodiff {
+
+    // Evaluates flat trees over row tiles of a columnar data set together
+    // with their derivatives by every constant, in forward mode and without
+    // a tape. Each node carries its value column and one derivative column
+    // per constant below it; constants are numbered in prefix order (as by
+    // tree::flatten), so those of a subtree are a contiguous range and the
+    // work per node follows the constants under it, not all of them.
+    // Operators need partials(), see operators::primitive_set.
+    template<class ValueType>
+    class evaluator{
+    private:
+        struct entry{
+            ValueType const* value;
+            ValueType const* grads;     // hi - lo columns of tile_rows values
+            std::size_t lo;
+            std::size_t hi;
+        };
+
+        std::size_t tile_rows;
+        std::vector<ValueType> scratch;
+        std::vector<std::size_t> offsets;   // of each node's columns in scratch
+        std::vector<std::size_t> counts;
+        std::vector<entry> stack;
+
+        // places the columns of every node, then the ones column and the
+        // partial derivatives of the operator at hand; returns the size
+        template<class Primitives>
+        std::size_t layout(std::vector<tree::flat_node> const& code)
+        {
+            offsets.resize(code.size());
+            counts.clear();
+            std::size_t cursor = 0;
+            for(std::size_t i = code.size(); i-- > 0;){
+                auto const& n = code[i];
+                std::size_t count = 0;
+                if(n.kind == tree::constant_value){
+                    count = 1;
+                    offsets[i] = cursor;
+                    cursor += tile_rows;
+                }else if(n.kind == tree::knot_value){
+                    for(std::size_t c = 0; c < Primitives::arity(n.payload); ++c){
+                        count += counts.back();
+                        counts.pop_back();
+                    }
+                    offsets[i] = cursor;
+                    cursor += (1 + count) * tile_rows;
+                }
+                counts.push_back(count);
+            }
+            return cursor + (1 + Primitives::max_arity) * tile_rows;
+        }
+
+    public:
+        evaluator() : evaluator(config::batch_tile_rows) {}
+        explicit evaluator(std::size_t const tile_rows_)
+            : tile_rows(std::max<std::size_t>(tile_rows_, 1)), scratch(), offsets(), counts(), stack()
+        {}
+
+        // out[r] = t(columns[0][r], ...) and grads[p][r] = its derivative
+        // by constant p of t.constant_pool(), for r in [0, rows)
+        template<class RandomTermGen, class Primitives>
+        void operator()(tree::flat_tree<ValueType, RandomTermGen, Primitives> const& t,
+                        ValueType const* const* columns,
+                        std::size_t const rows,
+                        ValueType* out,
+                        ValueType* const* grads)
+        {
+            auto const& code = t.code();
+            auto const& constants = t.constant_pool();
+            std::size_t const size = layout<Primitives>(code);
+            if(scratch.size() < size){
+                scratch.resize(size);
+            }
+            ValueType* const base = scratch.data();
+            ValueType* const ones = base + size - (1 + Primitives::max_arity) * tile_rows;
+            std::fill(ones, ones + tile_rows, ValueType(1));
+            ValueType* d[Primitives::max_arity];
+            for(std::size_t c = 0; c < Primitives::max_arity; ++c){
+                d[c] = ones + (1 + c) * tile_rows;
+            }
+
+            for(std::size_t begin = 0; begin < rows; begin += tile_rows){
+                std::size_t const n = std::min(tile_rows, rows - begin);
+                stack.clear();
+                for(std::size_t i = code.size(); i-- > 0;){
+                    auto const& node = code[i];
+                    ValueType* const own = base + offsets[i];
+                    if(node.kind == tree::constant_value){
+                        std::fill(own, own + n, constants[node.payload]);
+                        stack.push_back({own, ones, node.payload, node.payload + 1});
+                    }else if(node.kind == tree::variable_value){
+                        stack.push_back({columns[node.payload] + begin, nullptr, 0, 0});
+                    }else{
+                        // operands are on the stack in reverse order: the first one on top
+                        std::size_t const arity = Primitives::arity(node.payload);
+                        ValueType const* args[Primitives::max_arity];
+                        entry children[Primitives::max_arity];
+                        std::size_t lo = std::numeric_limits<std::size_t>::max(), hi = 0;
+                        for(std::size_t c = 0; c < arity; ++c){
+                            children[c] = stack[stack.size() - 1 - c];
+                            args[c] = children[c].value;
+                            if(children[c].lo != children[c].hi){
+                                lo = std::min(lo, children[c].lo);
+                                hi = std::max(hi, children[c].hi);
+                            }
+                        }
+                        stack.resize(stack.size() - arity);
+                        if(hi == 0){
+                            lo = 0;
+                        }
+
+                        Primitives::kernel(node.payload, own, args, n);
+                        ValueType* const own_grads = own + tile_rows;
+                        if(lo != hi){
+                            Primitives::partials(node.payload, d, args, n);
+                        }
+                        for(std::size_t c = 0; c < arity; ++c){
+                            for(std::size_t p = children[c].lo; p < children[c].hi; ++p){
+                                ValueType const* from = children[c].grads + (p - children[c].lo) * tile_rows;
+                                ValueType* to = own_grads + (p - lo) * tile_rows;
+                                for(std::size_t r = 0; r < n; ++r){
+                                    to[r] = d[c][r] * from[r];
+                                }
+                            }
+                        }
+                        stack.push_back({own, own_grads, lo, hi});
+                    }
+                }
+
+                entry const& root = stack.back();
+                std::copy(root.value, root.value + n, out + begin);
+                for(std::size_t p = 0; p < constants.size(); ++p){
+                    if(root.lo <= p && p < root.hi){
+                        ValueType const* from = root.grads + (p - root.lo) * tile_rows;
+                        std::copy(from, from + n, grads[p] + begin);
+                    }else{
+                        std::fill(grads[p] + begin, grads[p] + begin + n, ValueType(0));
+                    }
+                }
+            }
+        }
+    };
+
+    namespace impl {
+
+        // solves (h + lambda * diag(h)) x = -g by Cholesky decomposition,
+        // false if the matrix is not positive definite
+        template<class ValueType>
+        bool solve_damped(std::vector<ValueType> const& h,
+                          std::vector<ValueType> const& g,
+                          ValueType const lambda,
+                          std::vector<ValueType> &x)
+        {
+            std::size_t const p = g.size();
+            std::vector<ValueType> l(h);
+            for(std::size_t i = 0; i < p; ++i){
+                l[i * p + i] += lambda * std::max(h[i * p + i], std::numeric_limits<ValueType>::epsilon());
+            }
+            for(std::size_t j = 0; j < p; ++j){
+                ValueType diag = l[j * p + j];
+                for(std::size_t k = 0; k < j; ++k){
+                    diag -= l[j * p + k] * l[j * p + k];
+                }
+                if(!(diag > ValueType(0))){
+                    return false;
+                }
+                diag = std::sqrt(diag);
+                l[j * p + j] = diag;
+                for(std::size_t i = j + 1; i < p; ++i){
+                    ValueType v = l[i * p + j];
+                    for(std::size_t k = 0; k < j; ++k){
+                        v -= l[i * p + k] * l[j * p + k];
+                    }
+                    l[i * p + j] = v / diag;
+                }
+            }
+            x.assign(p, ValueType(0));
+            for(std::size_t i = 0; i < p; ++i){
+                ValueType v = -g[i];
+                for(std::size_t k = 0; k < i; ++k){
+                    v -= l[i * p + k] * x[k];
+                }
+                x[i] = v / l[i * p + i];
+            }
+            for(std::size_t i = p; i-- > 0;){
+                ValueType v = x[i];
+                for(std::size_t k = i + 1; k < p; ++k){
+                    v -= l[k * p + i] * x[k];
+                }
+                x[i] = v / l[i * p + i];
+            }
+            return true;
+        }
+
+        template<class ValueType>
+        ValueType squared_error(ValueType const* predicted, ValueType const* target, std::size_t const rows)
+        {
+            ValueType error = ValueType();
+            for(std::size_t r = 0; r < rows; ++r){
+                ValueType const diff = predicted[r] - target[r];
+                error += diff * diff;
+            }
+            return error;
+        }
+
+    } // namespace impl
+
+    // Fits the constants of t to target[r] over rows r of columns by
+    // Levenberg-Marquardt on the squared error, for at most iterations
+    // steps, accepted or not. Each accepted step costs one evaluation with
+    // derivatives (see evaluator), each rejected one a plain evaluation.
+    // The constants are only changed if that lowers the error. Returns the
+    // sum of squared errors, non-finite if t is.
+    template<class ValueType, class RandomTermGen, class Primitives>
+    ValueType fit_constants(tree::flat_tree<ValueType, RandomTermGen, Primitives> &t,
+                            ValueType const* const* columns,
+                            std::size_t const rows,
+                            ValueType const* target,
+                            std::size_t const iterations)
+    {
+        std::size_t const p = t.constant_pool().size();
+        std::vector<ValueType> predicted(rows);
+        std::vector<std::vector<ValueType>> jacobian(p, std::vector<ValueType>(rows));
+        std::vector<ValueType*> jacobian_ptrs(p);
+        for(std::size_t i = 0; i < p; ++i){
+            jacobian_ptrs[i] = jacobian[i].data();
+        }
+        evaluator<ValueType> eval;
+        batch::evaluator<ValueType> plain;
+
+        std::vector<ValueType> g(p), h(p * p), step;
+        auto linearize = [&]{
+            eval(t, columns, rows, predicted.data(), jacobian_ptrs.data());
+            std::fill(g.begin(), g.end(), ValueType(0));
+            std::fill(h.begin(), h.end(), ValueType(0));
+            for(std::size_t i = 0; i < p; ++i){
+                ValueType const* ji = jacobian_ptrs[i];
+                for(std::size_t r = 0; r < rows; ++r){
+                    g[i] += ji[r] * (predicted[r] - target[r]);
+                }
+                for(std::size_t k = 0; k <= i; ++k){
+                    ValueType const* jk = jacobian_ptrs[k];
+                    ValueType v = ValueType();
+                    for(std::size_t r = 0; r < rows; ++r){
+                        v += ji[r] * jk[r];
+                    }
+                    h[i * p + k] = h[k * p + i] = v;
+                }
+            }
+            return impl::squared_error(predicted.data(), target, rows);
+        };
+
+        if(p == 0 || rows == 0){
+            plain(t, columns, rows, predicted.data());
+            return impl::squared_error(predicted.data(), target, rows);
+        }
+        ValueType error = linearize();
+        if(!std::isfinite(error)){
+            return error;
+        }
+        ValueType lambda = ValueType(1e-3);
+        for(std::size_t iteration = 0; iteration < iterations && error > ValueType(0); ++iteration){
+            bool const g_finite = std::all_of(g.begin(), g.end(), [](ValueType const v){ return std::isfinite(v); });
+            if(!g_finite || lambda > ValueType(1e10)){
+                break;
+            }
+            if(!impl::solve_damped(h, g, lambda, step)){
+                lambda *= 10;
+                continue;
+            }
+            auto trial_constants = t.constant_pool();
+            for(std::size_t i = 0; i < p; ++i){
+                trial_constants[i] += step[i];
+            }
+            tree::flat_tree<ValueType, RandomTermGen, Primitives> trial(t.code(), std::move(trial_constants));
+            plain(trial, columns, rows, predicted.data());
+            ValueType const trial_error = impl::squared_error(predicted.data(), target, rows);
+            if(std::isfinite(trial_error) && trial_error < error){
+                t.swap(trial);
+                error = linearize();
+                lambda = std::max(lambda / 10, ValueType(1e-12));
+            }else{
+                lambda *= 10;
+            }
+        }
+        return error;
+    }
+
+} // namespace autodiff
+
+} // namespace gene
+
+#endif    // GENE_AUTODIFF_HPP_INCLUDED
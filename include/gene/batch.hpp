@@ -0,0 +1,218 @@
+#if !defined GENE_BATCH_HPP_INCLUDED
+#define      GENE_BATCH_HPP_INCLUDED
+
+#include "config.hpp"
+#include "node.hpp"
+#include "operators.hpp"
+#include "tree.hpp"
+#include "flat_tree.hpp"
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+#include <cstddef>
+
+namespace gene {
+
+namespace batch {
+
+    // Structure-of-arrays storage of a data set: one contiguous column per variable.
+    // A columns object owns its data, or is a read-only view made with view()
+    // or slice() of columns stored elsewhere, e.g. in a memory-mapped dataset.
+    template<class ValueType>
+    class columns{
+    private:
+        std::vector<std::vector<ValueType>> data;
+        std::vector<ValueType const*> external;
+        std::shared_ptr<void const> owner;  // keeps the viewed storage alive, if set
+        std::size_t row_count;
+        bool viewing;
+
+    public:
+        columns() : data(), external(), owner(), row_count(0), viewing(false) {}
+        columns(std::size_t const column_count, std::size_t const rows)
+            : data(column_count, std::vector<ValueType>(rows)), external(), owner(), row_count(rows), viewing(false)
+        {}
+
+        // Refers to rows values at each of column_ptrs without copying them.
+        // The storage must outlive the view, unless owner keeps it alive.
+        static columns view(std::vector<ValueType const*> column_ptrs,
+                            std::size_t const rows,
+                            std::shared_ptr<void const> owner_ = nullptr)
+        {
+            columns retval;
+            retval.external = std::move(column_ptrs);
+            retval.owner = std::move(owner_);
+            retval.row_count = rows;
+            retval.viewing = true;
+            return retval;
+        }
+
+        // view of rows [first, first + count) of every column
+        columns slice(std::size_t const first, std::size_t const count) const
+        {
+            if(first + count > row_count){
+                throw("gene::batch::columns::slice: rows out of range.");
+            }
+            std::vector<ValueType const*> ptrs = pointers();
+            for(auto &p : ptrs){
+                p += first;
+            }
+            return view(std::move(ptrs), count, owner);
+        }
+
+        bool is_view() const
+        {
+            return viewing;
+        }
+
+        std::size_t size() const
+        {
+            return viewing ? external.size() : data.size();
+        }
+
+        std::size_t rows() const
+        {
+            return row_count;
+        }
+
+        ValueType* column(std::size_t const i)
+        {
+            if(viewing){
+                throw("gene::batch::columns::column: views are read-only.");
+            }
+            return data[i].data();
+        }
+
+        ValueType const* column(std::size_t const i) const
+        {
+            return viewing ? external[i] : data[i].data();
+        }
+
+        std::vector<ValueType const*> pointers() const
+        {
+            if(viewing){
+                return external;
+            }
+            std::vector<ValueType const*> retval;
+            for(auto const& c : data){
+                retval.push_back(c.data());
+            }
+            return retval;
+        }
+
+        template<class Row>
+        void push_back(Row const& row)
+        {
+            if(viewing){
+                throw("gene::batch::columns::push_back: views are read-only.");
+            }
+            for(std::size_t i = 0; i < data.size(); ++i){
+                data[i].push_back(row[i]);
+            }
+            ++row_count;
+        }
+
+        void clear()
+        {
+            if(viewing){
+                throw("gene::batch::columns::clear: views are read-only.");
+            }
+            for(auto &c : data){
+                c.clear();
+            }
+            row_count = 0;
+        }
+    };
+
+    // Evaluates flat trees over row tiles of a columnar data set.
+    // Each operator runs as a vectorized kernel (see operators.hpp and simd.hpp)
+    // over a whole tile; the scratch buffers are kept between calls.
+    template<class ValueType>
+    class evaluator{
+    private:
+        std::size_t tile_rows;
+        std::vector<ValueType> scratch;
+        std::vector<ValueType const*> stack;
+
+        template<class Primitives>
+        static std::size_t max_stack(std::vector<tree::flat_node> const& code)
+        {
+            std::size_t sp = 0, retval = 0;
+            for(auto i = code.rbegin(); i != code.rend(); ++i){
+                sp = sp + 1 - tree::arity_of<Primitives>(*i);
+                retval = std::max(retval, sp);
+            }
+            return retval;
+        }
+
+    public:
+        evaluator() : tile_rows(config::batch_tile_rows), scratch(), stack() {}
+        explicit evaluator(std::size_t const tile_rows_) : tile_rows(tile_rows_), scratch(), stack() {}
+
+        // out[r] = t(columns[0][r], columns[1][r], ...) for r in [0, rows)
+        template<class RandomTermGen, class Primitives>
+        void operator()(tree::flat_tree<ValueType, RandomTermGen, Primitives> const& t,
+                        ValueType const* const* columns,
+                        std::size_t const rows,
+                        ValueType* out)
+        {
+            auto const& code = t.code();
+            auto const& constants = t.constant_pool();
+            auto const depth = max_stack<Primitives>(code);
+            if(scratch.size() < depth * tile_rows){
+                scratch.resize(depth * tile_rows);
+            }
+            stack.resize(depth);
+
+            for(std::size_t begin = 0; begin < rows; begin += tile_rows){
+                std::size_t const n = std::min(tile_rows, rows - begin);
+                std::size_t sp = 0;
+                for(auto i = code.rbegin(); i != code.rend(); ++i){
+                    ValueType* buffer = scratch.data() + sp * tile_rows;
+                    if(i->kind == tree::constant_value){
+                        std::fill(buffer, buffer + n, constants[i->payload]);
+                        stack[sp++] = buffer;
+                    }else if(i->kind == tree::variable_value){
+                        stack[sp++] = columns[i->payload] + begin;
+                    }else{
+                        // operands are on the stack in reverse order: the first one on top
+                        auto const arity = Primitives::arity(i->payload);
+                        ValueType const* args[Primitives::max_arity];
+                        for(std::size_t c = 0; c < arity; ++c){
+                            args[c] = stack[sp-1-c];
+                        }
+                        sp -= arity;
+                        buffer = scratch.data() + sp * tile_rows;
+                        Primitives::kernel(i->payload, buffer, args, n);
+                        stack[sp++] = buffer;
+                    }
+                }
+                std::copy(stack[0], stack[0] + n, out + begin);
+            }
+        }
+    };
+
+    template<class ValueType, class RandomTermGen, class Primitives>
+    inline std::vector<ValueType> values(tree::flat_tree<ValueType, RandomTermGen, Primitives> const& t,
+                                         columns<ValueType> const& inputs)
+    {
+        std::vector<ValueType> retval(inputs.rows());
+        auto const ptrs = inputs.pointers();
+        evaluator<ValueType>()(t, ptrs.data(), inputs.rows(), retval.data());
+        return retval;
+    }
+
+    template<class ValueType, class RandomTermGen, class Primitives>
+    inline std::vector<ValueType> values(tree::tree<ValueType, RandomTermGen, Primitives> const& t,
+                                         columns<ValueType> const& inputs)
+    {
+        return values(tree::flatten(t), inputs);
+    }
+
+} // namespace batch
+
+} // namespace gene
+
+#endif    // GENE_BATCH_HPP_INCLUDED
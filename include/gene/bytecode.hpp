@@ -0,0 +1,363 @@
+#if !defined GENE_BYTECODE_HPP_INCLUDED
+#define      GENE_BYTECODE_HPP_INCLUDED
+
+#include "node.hpp"
+#include "operators.hpp"
+#include "tree.hpp"
+#include "flat_tree.hpp"
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+
+// GCC and Clang dispatch through a table of label addresses (computed goto);
+// other compilers, or GENE_NO_COMPUTED_GOTO, fall back to a switch loop.
+#if defined __GNUC__ && !defined GENE_NO_COMPUTED_GOTO
+#  define GENE_BYTECODE_THREADED
+#endif
+
+namespace gene {
+
+namespace bytecode {
+
+    // Stack machine opcodes.
+    // For a binary operator op the suffix tells where the operands come from:
+    //   s: stack, c: constant pool, v: input variable
+    // e.g. plus_vc is "push x_a + k_b", plus_sc is "top = top + k_a".
+    // Operators without superinstructions use call: "pop b operands, push
+    // operator a of them", through the scalar table of the primitive set.
+#define GENE_BYTECODE_BINARY_OPCODES(X, op) \
+    X(op##_ss) X(op##_sc) X(op##_cs) X(op##_sv) X(op##_vs) X(op##_vc) X(op##_cv) X(op##_vv)
+
+#define GENE_BYTECODE_OPCODES(X)              \
+    X(push_const) X(push_var)                 \
+    GENE_BYTECODE_BINARY_OPCODES(X, plus)     \
+    GENE_BYTECODE_BINARY_OPCODES(X, minus)    \
+    GENE_BYTECODE_BINARY_OPCODES(X, mult)     \
+    GENE_BYTECODE_BINARY_OPCODES(X, divide)   \
+    X(abs_s) X(abs_v) X(sqrt_s) X(sqrt_v)     \
+    X(call) X(ret)
+
+#define GENE_BYTECODE_ENUM(name) name,
+    enum struct opcode : std::uint16_t{
+        GENE_BYTECODE_OPCODES(GENE_BYTECODE_ENUM)
+    };
+#undef GENE_BYTECODE_ENUM
+
+    struct instruction{
+        opcode code;
+        std::uint32_t a;
+        std::uint32_t b;
+    };
+
+    namespace impl {
+
+        // one row of a columnar data set, indexed by variable
+        template<class ValueType>
+        struct row_ref{
+            ValueType const* const* columns;
+            std::size_t row;
+            ValueType operator[](std::size_t const i) const
+            {
+                return columns[i][row];
+            }
+        };
+
+        // the first superinstruction of an operator, call if it has none
+        template<class Operator>
+        struct native : std::integral_constant<opcode, opcode::call> {};
+
+        template<> struct native<tree::operators::plus> : std::integral_constant<opcode, opcode::plus_ss> {};
+        template<> struct native<tree::operators::minus> : std::integral_constant<opcode, opcode::minus_ss> {};
+        template<> struct native<tree::operators::mult> : std::integral_constant<opcode, opcode::mult_ss> {};
+        template<> struct native<tree::operators::divide> : std::integral_constant<opcode, opcode::divide_ss> {};
+        template<> struct native<tree::operators::abs> : std::integral_constant<opcode, opcode::abs_s> {};
+        template<> struct native<tree::operators::sqrt> : std::integral_constant<opcode, opcode::sqrt_s> {};
+
+        template<class Primitives>
+        struct native_table;
+
+        template<class... Operators>
+        struct native_table<tree::operators::primitive_set<Operators...>>{
+            static opcode base(std::size_t const op_index)
+            {
+                static opcode const table[] = { native<Operators>::value... };
+                return table[op_index];
+            }
+        };
+
+        // offsets from binary_base, in the order of GENE_BYTECODE_BINARY_OPCODES
+        enum binary_form { ss = 0, sc, cs, sv, vs, vc, cv, vv };
+
+        inline opcode offset(opcode const base, std::size_t const form)
+        {
+            return static_cast<opcode>(static_cast<std::size_t>(base) + form);
+        }
+
+    } // namespace impl
+
+    // A tree lowered to stack machine code.
+    // Compile once with bytecode::compile() and run it many times.
+    template<class ValueType>
+    class program{
+    public:
+        typedef ValueType (*function_type)(ValueType const*);
+
+    private:
+        std::vector<instruction> code;
+        std::vector<ValueType> constants;
+        std::size_t stack_size;
+        function_type const* functions;     // operators reached by call
+
+        // largest stack run() can place on the machine stack
+        static constexpr std::size_t local_stack_size = 64;
+
+        template<class Vars>
+        ValueType execute(Vars const& vars, ValueType* const stack) const
+        {
+            instruction const* ip = code.data();
+            ValueType* sp = stack;
+            ValueType const* const k = constants.data();
+            function_type const* const f = functions;
+
+#if defined GENE_BYTECODE_THREADED
+#  define GENE_BYTECODE_LABEL(name) &&op_##name,
+            static void* const labels[] = { GENE_BYTECODE_OPCODES(GENE_BYTECODE_LABEL) };
+#  undef GENE_BYTECODE_LABEL
+#  define GENE_BYTECODE_OP(name) op_##name:
+#  define GENE_BYTECODE_NEXT goto *labels[static_cast<std::size_t>((++ip)->code)]
+            goto *labels[static_cast<std::size_t>(ip->code)];
+#else
+#  define GENE_BYTECODE_OP(name) case opcode::name:
+#  define GENE_BYTECODE_NEXT ++ip; continue
+            for(;;){
+            switch(ip->code){
+#endif
+
+#define GENE_BYTECODE_BINARY(name, Operator)                                                     \
+            GENE_BYTECODE_OP(name##_ss) sp[-2] = Operator()(sp[-2], sp[-1]); --sp; GENE_BYTECODE_NEXT; \
+            GENE_BYTECODE_OP(name##_sc) sp[-1] = Operator()(sp[-1], k[ip->a]); GENE_BYTECODE_NEXT;     \
+            GENE_BYTECODE_OP(name##_cs) sp[-1] = Operator()(k[ip->a], sp[-1]); GENE_BYTECODE_NEXT;     \
+            GENE_BYTECODE_OP(name##_sv) sp[-1] = Operator()(sp[-1], vars[ip->a]); GENE_BYTECODE_NEXT;  \
+            GENE_BYTECODE_OP(name##_vs) sp[-1] = Operator()(vars[ip->a], sp[-1]); GENE_BYTECODE_NEXT;  \
+            GENE_BYTECODE_OP(name##_vc) *sp++ = Operator()(vars[ip->a], k[ip->b]); GENE_BYTECODE_NEXT; \
+            GENE_BYTECODE_OP(name##_cv) *sp++ = Operator()(k[ip->a], vars[ip->b]); GENE_BYTECODE_NEXT; \
+            GENE_BYTECODE_OP(name##_vv) *sp++ = Operator()(vars[ip->a], vars[ip->b]); GENE_BYTECODE_NEXT;
+
+            GENE_BYTECODE_OP(push_const) *sp++ = k[ip->a]; GENE_BYTECODE_NEXT;
+            GENE_BYTECODE_OP(push_var) *sp++ = vars[ip->a]; GENE_BYTECODE_NEXT;
+            GENE_BYTECODE_BINARY(plus, tree::operators::plus)
+            GENE_BYTECODE_BINARY(minus, tree::operators::minus)
+            GENE_BYTECODE_BINARY(mult, tree::operators::mult)
+            GENE_BYTECODE_BINARY(divide, tree::operators::divide)
+            GENE_BYTECODE_OP(abs_s) sp[-1] = tree::operators::abs()(sp[-1]); GENE_BYTECODE_NEXT;
+            GENE_BYTECODE_OP(abs_v) *sp++ = tree::operators::abs()(vars[ip->a]); GENE_BYTECODE_NEXT;
+            GENE_BYTECODE_OP(sqrt_s) sp[-1] = tree::operators::sqrt()(sp[-1]); GENE_BYTECODE_NEXT;
+            GENE_BYTECODE_OP(sqrt_v) *sp++ = tree::operators::sqrt()(vars[ip->a]); GENE_BYTECODE_NEXT;
+            GENE_BYTECODE_OP(call) sp -= ip->b; *sp = f[ip->a](sp); ++sp; GENE_BYTECODE_NEXT;
+            GENE_BYTECODE_OP(ret) return sp[-1];
+
+#if !defined GENE_BYTECODE_THREADED
+            }
+            }
+#endif
+#undef GENE_BYTECODE_BINARY
+#undef GENE_BYTECODE_NEXT
+#undef GENE_BYTECODE_OP
+        }
+
+        template<class Vars>
+        ValueType run(Vars const& vars) const
+        {
+            if(stack_size <= local_stack_size){
+                ValueType stack[local_stack_size];
+                return execute(vars, stack);
+            }
+            std::vector<ValueType> stack(stack_size);
+            return execute(vars, stack.data());
+        }
+
+    public:
+        program() : code(), constants(), stack_size(0), functions(nullptr) {}
+        program(std::vector<instruction> code_, std::vector<ValueType> constants_, std::size_t const stack_size_,
+                function_type const* const functions_ = nullptr)
+            : code(std::move(code_)), constants(std::move(constants_)), stack_size(stack_size_), functions(functions_)
+        {}
+
+        template<std::size_t InputSize>
+        ValueType operator()(std::array<ValueType, InputSize> const& variable_values) const
+        {
+            return run(variable_values);
+        }
+
+        // out[r] = program(columns[0][r], columns[1][r], ...) for r in [0, rows)
+        void operator()(ValueType const* const* columns, std::size_t const rows, ValueType* out) const
+        {
+            std::vector<ValueType> stack(stack_size);
+            for(std::size_t r = 0; r < rows; ++r){
+                out[r] = execute(impl::row_ref<ValueType>{columns, r}, stack.data());
+            }
+        }
+
+        bool empty() const
+        {
+            return code.empty();
+        }
+
+        std::vector<instruction> const& instructions() const
+        {
+            return code;
+        }
+
+        std::size_t max_stack() const
+        {
+            return stack_size;
+        }
+    };
+
+    namespace impl {
+
+        template<class ValueType, class RandomTermGen, class Primitives>
+        class compiler{
+        private:
+            tree::flat_tree<ValueType, RandomTermGen, Primitives> const& source;
+            std::vector<instruction> &code;
+            std::vector<ValueType> &constants;
+            std::size_t depth;
+            std::size_t max_depth;
+
+            void push(std::size_t const n)
+            {
+                depth += n;
+                max_depth = std::max(max_depth, depth);
+            }
+
+            std::uint32_t constant(std::size_t const pos)
+            {
+                constants.push_back(source.constant_pool()[source.code()[pos].payload]);
+                return static_cast<std::uint32_t>(constants.size() - 1);
+            }
+
+            bool is_leaf(std::size_t const pos) const
+            {
+                return source.code()[pos].kind != tree::knot_value;
+            }
+
+            // operand of a superinstruction: constant pool or variable index
+            std::uint32_t operand(std::size_t const pos)
+            {
+                return source.code()[pos].kind == tree::constant_value ? constant(pos) : source.code()[pos].payload;
+            }
+
+            void emit(opcode const c, std::uint32_t const a = 0, std::uint32_t const b = 0)
+            {
+                code.push_back({c, a, b});
+            }
+
+            // emits code leaving the value of the subtree at pos on top of the stack,
+            // returns the position following the subtree
+            std::size_t subtree(std::size_t const pos)
+            {
+                auto const& n = source.code()[pos];
+                if(n.kind == tree::constant_value){
+                    emit(opcode::push_const, constant(pos));
+                    push(1);
+                    return pos + 1;
+                }else if(n.kind == tree::variable_value){
+                    emit(opcode::push_var, n.payload);
+                    push(1);
+                    return pos + 1;
+                }
+
+                auto const base = native_table<Primitives>::base(n.payload);
+                auto const arity = Primitives::arity(n.payload);
+                if(base == opcode::call){
+                    auto child = pos + 1;
+                    for(std::size_t c = 0; c < arity; ++c){
+                        child = subtree(child);
+                    }
+                    emit(opcode::call, n.payload, static_cast<std::uint32_t>(arity));
+                    depth -= arity - 1;
+                    return child;
+                }
+
+                if(arity == 1){
+                    auto const child = pos + 1;
+                    if(source.code()[child].kind == tree::variable_value){
+                        emit(offset(base, 1), source.code()[child].payload);
+                        push(1);
+                        return child + 1;
+                    }
+                    subtree(child);
+                    emit(base);
+                    return source.subtree_end(pos);
+                }
+
+                auto const lhs = pos + 1;
+                auto const rhs = source.subtree_end(lhs);
+                auto const last = source.subtree_end(rhs);
+                bool const lhs_var = source.code()[lhs].kind == tree::variable_value;
+                bool const rhs_var = source.code()[rhs].kind == tree::variable_value;
+
+                if(is_leaf(lhs) && is_leaf(rhs) && (lhs_var || rhs_var)){
+                    auto const a = operand(lhs);
+                    auto const b = operand(rhs);
+                    emit(offset(base, lhs_var ? (rhs_var ? vv : vc) : cv), a, b);
+                    push(1);
+                }else if(is_leaf(lhs)){
+                    subtree(rhs);
+                    emit(offset(base, lhs_var ? vs : cs), operand(lhs));
+                }else if(is_leaf(rhs)){
+                    subtree(lhs);
+                    emit(offset(base, rhs_var ? sv : sc), operand(rhs));
+                }else{
+                    subtree(lhs);
+                    subtree(rhs);
+                    emit(base);
+                    --depth;
+                }
+                return last;
+            }
+
+        public:
+            compiler(tree::flat_tree<ValueType, RandomTermGen, Primitives> const& source_,
+                     std::vector<instruction> &code_,
+                     std::vector<ValueType> &constants_)
+                : source(source_), code(code_), constants(constants_), depth(0), max_depth(0)
+            {}
+
+            std::size_t operator()()
+            {
+                subtree(0);
+                emit(opcode::ret);
+                return max_depth;
+            }
+        };
+
+    } // namespace impl
+
+    template<class ValueType, class RandomTermGen, class Primitives>
+    inline program<ValueType> compile(tree::flat_tree<ValueType, RandomTermGen, Primitives> const& t)
+    {
+        std::vector<instruction> code;
+        std::vector<ValueType> constants;
+        code.reserve(t.size() + 1);
+        auto const stack_size = impl::compiler<ValueType, RandomTermGen, Primitives>(t, code, constants)();
+        return {std::move(code), std::move(constants), stack_size, Primitives::template scalar_table<ValueType>()};
+    }
+
+    template<class ValueType, class RandomTermGen, class Primitives>
+    inline program<ValueType> compile(tree::tree<ValueType, RandomTermGen, Primitives> const& t)
+    {
+        return compile(tree::flatten(t));
+    }
+
+} // namespace bytecode
+
+} // namespace gene
+
+#endif    // GENE_BYTECODE_HPP_INCLUDED
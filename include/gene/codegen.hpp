@@ -0,0 +1,244 @@
+#if !defined GENE_CODEGEN_HPP_INCLUDED
+#define      GENE_CODEGEN_HPP_INCLUDED
+
+#include "config.hpp"
+#include "node.hpp"
+#include "operators.hpp"
+#include "tree.hpp"
+#include "flat_tree.hpp"
+#include "individual.hpp"
+
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <sstream>
+#include <ostream>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+
+// Exports individuals as self-contained C++ headers, so a model can be
+// compiled into a service with no dependency on this library. A header
+// generated for namespace ns declares
+//
+//   ns::input_size, ns::output_size
+//   void predict(T const* x, T* y)                  // one row, y[i] = tree i
+//   std::array<T, output_size> predict(std::array<T, input_size> const& x)
+//   void predict(T const* const* columns, std::size_t rows, T* const* outputs)
+//                                                   // columnar, as batch::columns
+//   void predict_rows(T const* x, std::size_t rows, T* y)
+//                                                   // row-major x and y
+//
+// The body of predict is straight-line code: one local per operator,
+// every output tree fused into the same function and subtrees that occur
+// more than once, within a tree or across trees, computed once. Constants
+// are written with max_digits10 digits and round-trip exactly. The code is
+// C++11 and needs only <array>, <cmath> and <cstddef>.
+
+namespace gene {
+
+namespace codegen {
+
+    template<class ValueType>
+    struct type_traits;
+
+    template<>
+    struct type_traits<float>{
+        static char const* name() { return "float"; }
+        static char const* suffix() { return "f"; }
+    };
+
+    template<>
+    struct type_traits<double>{
+        static char const* name() { return "double"; }
+        static char const* suffix() { return ""; }
+    };
+
+    template<>
+    struct type_traits<long double>{
+        static char const* name() { return "long double"; }
+        static char const* suffix() { return "L"; }
+    };
+
+    namespace impl {
+
+        template<class ValueType>
+        std::string literal(ValueType const v)
+        {
+            typedef type_traits<ValueType> traits;
+            std::string const type = traits::name();
+            if(std::isnan(v)){
+                return "(" + type + "(0) / " + type + "(0))";
+            }
+            if(std::isinf(v)){
+                return std::string(v < 0 ? "(-" : "(") + type + "(1) / " + type + "(0))";
+            }
+            std::ostringstream out;
+            out << std::scientific << std::setprecision(std::numeric_limits<ValueType>::max_digits10 - 1)
+                << v << traits::suffix();
+            return std::signbit(v) ? "(" + out.str() + ")" : out.str();
+        }
+
+        // Emits the operators of flat trees as locals, leaves inline.
+        // Each knot is keyed by its C++ expression over already emitted
+        // operands, so equal subtrees map to the same local.
+        template<class ValueType, class Primitives>
+        class emitter{
+        private:
+            std::string type;
+            std::vector<std::string> lines;
+            std::unordered_map<std::string, std::string> locals;
+
+        public:
+            emitter() : type(type_traits<ValueType>::name()), lines(), locals() {}
+
+            // C++ operand holding the value of t
+            template<class RandomTermGen>
+            std::string operator()(tree::flat_tree<ValueType, RandomTermGen, Primitives> const& t)
+            {
+                auto const& code = t.code();
+                std::vector<std::string> stack;
+                for(auto i = code.rbegin(); i != code.rend(); ++i){
+                    if(i->kind == tree::constant_value){
+                        stack.push_back(literal(t.constant_pool()[i->payload]));
+                    }else if(i->kind == tree::variable_value){
+                        stack.push_back("x[" + std::to_string(i->payload) + "]");
+                    }else{
+                        // operands are on the stack in reverse order: the first one on top
+                        std::vector<std::string> args(Primitives::arity(i->payload));
+                        for(auto &a : args){
+                            a = std::move(stack.back());
+                            stack.pop_back();
+                        }
+                        auto expr = Primitives::to_cpp(i->payload, args);
+                        auto const found = locals.find(expr);
+                        if(found != locals.end()){
+                            stack.push_back(found->second);
+                        }else{
+                            std::string name = "t" + std::to_string(locals.size());
+                            lines.push_back(type + " const " + name + " = " + expr + ";");
+                            locals.emplace(std::move(expr), name);
+                            stack.push_back(std::move(name));
+                        }
+                    }
+                }
+                return stack.back();
+            }
+
+            std::vector<std::string> const& body() const
+            {
+                return lines;
+            }
+        };
+
+    } // namespace impl
+
+    // Writes ind as a header declaring its model in namespace name_space,
+    // see the top of this file. Trees are written as they are; simplify
+    // the individual first to drop dead code.
+    template<class ValueType, std::size_t InputSize, std::size_t ValueSize, class RandomTermGen, class Primitives>
+    void write_header(std::ostream &out,
+                      individual::individual<ValueType, InputSize, ValueSize, RandomTermGen, Primitives> const& ind,
+                      std::string const& name_space = "gene_model")
+    {
+        std::string const t = type_traits<ValueType>::name();
+        std::string const guard = "GENE_GENERATED_" + name_space + "_HPP_INCLUDED";
+
+        impl::emitter<ValueType, Primitives> emit;
+        std::array<std::string, ValueSize> results;
+        for(std::size_t i = 0; i < ValueSize; ++i){
+            results[i] = emit(tree::flatten(ind.get_trees()[i]));
+        }
+
+        out << "// Generated by gene::codegen::write_header.\n"
+            << "//\n";
+        for(auto const& e : ind.get_trees()){
+            out << "// " << e.expression() << '\n';
+        }
+        out << "#if !defined " << guard << '\n'
+            << "#define      " << guard << "\n\n"
+            << "#include <array>\n"
+            << "#include <cmath>\n"
+            << "#include <cstddef>\n\n"
+            << "namespace " << name_space << " {\n\n"
+            << "    constexpr std::size_t input_size = " << InputSize << ";\n"
+            << "    constexpr std::size_t output_size = " << ValueSize << ";\n\n";
+
+        out << "    inline void predict(" << t << " const* x, " << t << "* y) noexcept\n"
+            << "    {\n"
+            << "        (void)x;\n";
+        for(auto const& line : emit.body()){
+            out << "        " << line << '\n';
+        }
+        for(std::size_t i = 0; i < ValueSize; ++i){
+            out << "        y[" << i << "] = " << results[i] << ";\n";
+        }
+        out << "    }\n\n";
+
+        out << "    inline std::array<" << t << ", output_size> predict(std::array<" << t << ", input_size> const& x) noexcept\n"
+            << "    {\n"
+            << "        std::array<" << t << ", output_size> y;\n"
+            << "        predict(x.data(), y.data());\n"
+            << "        return y;\n"
+            << "    }\n\n";
+
+        out << "    // outputs[i][r] = output i of row r, with x_j of row r at columns[j][r]\n"
+            << "    inline void predict(" << t << " const* const* columns, std::size_t const rows, " << t << "* const* outputs) noexcept\n"
+            << "    {\n"
+            << "        for(std::size_t r = 0; r < rows; ++r){\n"
+            << "            " << t << " x[input_size + 1];\n"
+            << "            " << t << " y[output_size];\n"
+            << "            for(std::size_t j = 0; j < input_size; ++j){\n"
+            << "                x[j] = columns[j][r];\n"
+            << "            }\n"
+            << "            predict(x, y);\n"
+            << "            for(std::size_t i = 0; i < output_size; ++i){\n"
+            << "                outputs[i][r] = y[i];\n"
+            << "            }\n"
+            << "        }\n"
+            << "    }\n\n";
+
+        out << "    // x holds rows * input_size values and y rows * output_size, row by row\n"
+            << "    inline void predict_rows(" << t << " const* x, std::size_t const rows, " << t << "* y) noexcept\n"
+            << "    {\n"
+            << "        for(std::size_t r = 0; r < rows; ++r){\n"
+            << "            predict(x + r * input_size, y + r * output_size);\n"
+            << "        }\n"
+            << "    }\n\n";
+
+        out << "} // namespace " << name_space << "\n\n"
+            << "#endif    // " << guard << '\n';
+    }
+
+    template<class ValueType, std::size_t InputSize, std::size_t ValueSize, class RandomTermGen, class Primitives>
+    std::string header(individual::individual<ValueType, InputSize, ValueSize, RandomTermGen, Primitives> const& ind,
+                       std::string const& name_space = "gene_model")
+    {
+        std::ostringstream out;
+        write_header(out, ind, name_space);
+        return out.str();
+    }
+
+    template<class ValueType, std::size_t InputSize, std::size_t ValueSize, class RandomTermGen, class Primitives>
+    void save_header(std::string const& path,
+                     individual::individual<ValueType, InputSize, ValueSize, RandomTermGen, Primitives> const& ind,
+                     std::string const& name_space = "gene_model")
+    {
+        std::ofstream out(path);
+        if(!out){
+            throw("gene::codegen::save_header: cannot open the file.");
+        }
+        write_header(out, ind, name_space);
+        if(!out){
+            throw("gene::codegen::save_header: write failed.");
+        }
+    }
+
+} // namespace codegen
+
+} // namespace gene
+
+#endif    // GENE_CODEGEN_HPP_INCLUDED
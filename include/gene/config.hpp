@@ -1,17 +1,51 @@
 #if !defined GENE_CONFIG_HPP_INCLUDED
 #define      GENE_CONFIG_HPP_INCLUDED
 
-#include <random>
 #include <cstddef>
 
 namespace gene {
 
 namespace config {
 
-    static std::mt19937 random_engine(std::random_device{}());
     static std::size_t indent_width = 4;
     static std::size_t random_tree_depth = 4;
     static std::size_t population_size = 100;
+    static std::size_t batch_tile_rows = 256;
+    static std::size_t thread_count = 0;    // 0: one per hardware thread
+    static bool hash_consing = false;       // share identical subtrees across a population
+    static std::size_t eval_cache_bytes = 0;        // subtree result cache budget; 0: disabled
+    static std::size_t eval_cache_min_nodes = 3;    // smallest subtree worth caching
+    static std::size_t fitness_table_size = 1 << 16; // memoized fitnesses; 0: disabled
+    static bool simplify_before_evaluation = false; // see tree::simplify
+    static bool uniform_node_selection = false;     // mutation and crossover points; false: biased to shallow nodes
+    static std::size_t max_tree_depth = 0;          // limits kept by mutation and crossover; 0: none
+    static std::size_t max_tree_size = 0;
+    static std::size_t breeding_attempts = 8;       // node choices tried before giving up on a limit, or offspring bred before keeping a duplicate
+    static std::size_t tournament_size = 4;
+    static std::size_t elite_count = 1;             // best individuals kept as they are
+    static double crossover_rate = 0.9;
+    static double mutation_rate = 0.1;
+    static bool steady_state = false;               // replace individuals in place instead of by generation
+    static std::size_t steady_state_batch = 32;     // offspring pairs bred before they are scored together
+    static std::size_t migration_interval = 10;     // island_model: generations between migrations; 0: never
+    static std::size_t migrant_count = 2;           // best individuals sent to each neighbour
+    static bool migration_barrier = false;          // islands wait for each other after migrating
+    static bool pin_threads = true;                 // one CPU per island thread
+    static std::size_t dataset_chunk_rows = 1 << 16; // rows per chunk when converting or scanning datasets
+    static bool early_abort = false;                // stop scoring offspring sure to lose, see population::next_generation
+    static double early_abort_quantile = 1.0;       // rank, from 0 for the best to 1 for the worst, of the bound to beat
+    static std::size_t fitness_block_rows = 4096;   // rows scored between early abort checks
+    static std::size_t minibatch_rows = 0;          // smallest subsample scored per generation; 0: all rows
+    static std::size_t minibatch_candidates = 8;    // best of each subsample scored again on all rows
+    static double minibatch_noise = 0.2;            // rank disagreement above which the subsample grows
+    static std::size_t tune_elites = 0;             // best individuals whose constants are fitted; 0: none
+    static std::size_t tune_iterations = 20;        // Levenberg-Marquardt steps per fit
+    static bool interval_folding = false;           // fold subtrees constant over the training inputs, see tree::fold_invariants
+    static bool interval_rejection = false;         // give trees undefined over the training inputs the worst fitness unscored
+    static bool interval_rejection_strict = false;  // ... and those that may be undefined somewhere in their range
+    static std::size_t semantic_probe_rows = 0;     // training rows fingerprinting behaviour, see population::evaluate; 0: disabled
+    static int semantic_precision_bits = 20;        // significant bits kept of each output on them
+    static bool semantic_culling = false;           // breed again offspring behaving like one already bred
 
 } // namespace config
 } // namespace gene
@@ -0,0 +1,349 @@
+#if !defined GENE_DATASET_HPP_INCLUDED
+#define      GENE_DATASET_HPP_INCLUDED
+
+#include "config.hpp"
+#include "batch.hpp"
+#include "mapped_file.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <type_traits>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+// Columnar dataset file, in the byte order of the writing machine:
+//
+//   header   64 bytes: "GENC", u32 byte order mark 0x01020304,
+//            u32 format version, u32 sizeof(ValueType), u64 row count,
+//            u64 column count, zero padding
+//   columns  every column in turn, rows contiguous values each, starting
+//            at 64-byte aligned offsets so the kernels get aligned loads
+
+namespace gene {
+
+namespace dataset {
+
+    constexpr std::uint32_t format_version = 1;
+
+    namespace impl {
+
+        constexpr char magic[4] = {'G', 'E', 'N', 'C'};
+        constexpr std::uint32_t byte_order_mark = 0x01020304;
+        constexpr std::size_t alignment = 64;
+
+        struct header{
+            char magic[4];
+            std::uint32_t byte_order_mark;
+            std::uint32_t version;
+            std::uint32_t value_size;
+            std::uint64_t rows;
+            std::uint64_t columns;
+            char reserved[32];
+        };
+        static_assert(sizeof(header) == alignment, "gene::dataset: header must fill one aligned block");
+
+        template<class ValueType>
+        std::uint64_t column_stride(std::uint64_t const rows)
+        {
+            return (rows * sizeof(ValueType) + alignment - 1) / alignment * alignment;
+        }
+
+        template<class ValueType>
+        std::uint64_t column_offset(std::uint64_t const rows, std::uint64_t const column)
+        {
+            return sizeof(header) + column * column_stride<ValueType>(rows);
+        }
+
+        template<class ValueType>
+        void write_header(std::ofstream &out, std::uint64_t const rows, std::uint64_t const columns)
+        {
+            header h;
+            std::memset(&h, 0, sizeof(h));
+            std::memcpy(h.magic, magic, sizeof(h.magic));
+            h.byte_order_mark = byte_order_mark;
+            h.version = format_version;
+            h.value_size = sizeof(ValueType);
+            h.rows = rows;
+            h.columns = columns;
+            out.seekp(0);
+            out.write(reinterpret_cast<char const*>(&h), sizeof(h));
+            // extend the file to its full size
+            std::uint64_t const size = column_offset<ValueType>(rows, columns);
+            if(size > sizeof(h)){
+                out.seekp(size - 1);
+                out.put('\0');
+            }
+        }
+
+        template<class ValueType>
+        void write_column_part(std::ofstream &out, std::uint64_t const rows, std::uint64_t const column,
+                               std::uint64_t const first_row, ValueType const* const values, std::size_t const n)
+        {
+            out.seekp(column_offset<ValueType>(rows, column) + first_row * sizeof(ValueType));
+            out.write(reinterpret_cast<char const*>(values), n * sizeof(ValueType));
+        }
+
+        template<class ValueType>
+        bool parse_value(char const* const first, char const* const last, ValueType &value)
+        {
+            static_assert(std::is_floating_point<ValueType>::value, "gene::dataset: CSV values must be floating point");
+            std::string const field(first, last);
+            char* end = nullptr;
+            errno = 0;
+            long double const v = std::strtold(field.c_str(), &end);
+            while(end && (*end == ' ' || *end == '\t' || *end == '\r')){
+                ++end;
+            }
+            if(end == field.c_str() || *end != '\0'){
+                return false;
+            }
+            value = static_cast<ValueType>(v);
+            return true;
+        }
+
+        // Splits line at delimiter into values; false if a field is not a number.
+        template<class ValueType>
+        bool parse_line(std::string const& line, char const delimiter, std::vector<ValueType> &values)
+        {
+            values.clear();
+            char const* first = line.data();
+            char const* const end = line.data() + line.size();
+            for(;;){
+                char const* last = first;
+                while(last != end && *last != delimiter){
+                    ++last;
+                }
+                ValueType v;
+                if(!parse_value(first, last, v)){
+                    return false;
+                }
+                values.push_back(v);
+                if(last == end){
+                    return true;
+                }
+                first = last + 1;
+            }
+        }
+
+        inline bool blank(std::string const& line)
+        {
+            return line.find_first_not_of(" \t\r") == std::string::npos;
+        }
+
+    } // namespace impl
+
+    // Writes in-memory columns as a dataset file.
+    template<class ValueType>
+    void write(std::string const& path, batch::columns<ValueType> const& columns)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if(!out){
+            throw("gene::dataset::write: cannot open file.");
+        }
+        impl::write_header<ValueType>(out, columns.rows(), columns.size());
+        for(std::size_t c = 0; c < columns.size(); ++c){
+            impl::write_column_part(out, columns.rows(), c, 0, columns.column(c), columns.rows());
+        }
+        if(!out){
+            throw("gene::dataset::write: write failed.");
+        }
+    }
+
+    // Converts a CSV file of numbers into a dataset file and returns the
+    // number of rows. The first line is skipped with has_header, blank lines
+    // are ignored. The CSV is read twice, once to count the rows and once to
+    // convert chunk_rows rows at a time, so memory use does not grow with
+    // the file size.
+    template<class ValueType>
+    std::size_t csv_to_columnar(std::string const& csv_path,
+                                std::string const& out_path,
+                                bool const has_header = true,
+                                char const delimiter = ',',
+                                std::size_t chunk_rows = config::dataset_chunk_rows)
+    {
+        chunk_rows = std::max<std::size_t>(chunk_rows, 1);
+        std::vector<char> read_buffer(1 << 20);
+        std::string line;
+        std::vector<ValueType> values;
+
+        std::uint64_t rows = 0;
+        std::size_t column_count = 0;
+        {
+            std::ifstream in;
+            in.rdbuf()->pubsetbuf(read_buffer.data(), read_buffer.size());
+            in.open(csv_path, std::ios::binary);
+            if(!in){
+                throw("gene::dataset::csv_to_columnar: cannot open CSV file.");
+            }
+            if(has_header){
+                std::getline(in, line);
+            }
+            while(std::getline(in, line)){
+                if(impl::blank(line)){
+                    continue;
+                }
+                if(rows == 0){
+                    if(!impl::parse_line(line, delimiter, values)){
+                        throw("gene::dataset::csv_to_columnar: invalid number in CSV file.");
+                    }
+                    column_count = values.size();
+                }
+                ++rows;
+            }
+        }
+
+        std::ofstream out(out_path, std::ios::binary | std::ios::trunc);
+        if(!out){
+            throw("gene::dataset::csv_to_columnar: cannot open output file.");
+        }
+        impl::write_header<ValueType>(out, rows, column_count);
+
+        std::ifstream in;
+        in.rdbuf()->pubsetbuf(read_buffer.data(), read_buffer.size());
+        in.open(csv_path, std::ios::binary);
+        if(has_header){
+            std::getline(in, line);
+        }
+        std::vector<std::vector<ValueType>> chunk(column_count);
+        std::uint64_t first_row = 0;
+        auto flush = [&]{
+            for(std::size_t c = 0; c < column_count; ++c){
+                impl::write_column_part(out, rows, c, first_row, chunk[c].data(), chunk[c].size());
+            }
+            first_row += chunk.empty() ? 0 : chunk[0].size();
+            for(auto &c : chunk){
+                c.clear();
+            }
+        };
+        std::uint64_t row = 0;
+        while(row < rows && std::getline(in, line)){
+            if(impl::blank(line)){
+                continue;
+            }
+            if(!impl::parse_line(line, delimiter, values)){
+                throw("gene::dataset::csv_to_columnar: invalid number in CSV file.");
+            }
+            if(values.size() != column_count){
+                throw("gene::dataset::csv_to_columnar: rows have different numbers of columns.");
+            }
+            for(std::size_t c = 0; c < column_count; ++c){
+                chunk[c].push_back(values[c]);
+            }
+            ++row;
+            if(row % chunk_rows == 0){
+                flush();
+            }
+        }
+        if(row != rows){
+            throw("gene::dataset::csv_to_columnar: CSV file changed while converting.");
+        }
+        flush();
+        if(!out){
+            throw("gene::dataset::csv_to_columnar: write failed.");
+        }
+        return rows;
+    }
+
+    // A dataset file mapped into memory. Columns are handed out as
+    // batch::columns views that keep the mapping alive, so nothing is copied
+    // and only the pages actually used are read.
+    template<class ValueType>
+    class mapped{
+    private:
+        std::shared_ptr<mapped_file const> file;
+        std::size_t row_count;
+        std::size_t column_count;
+
+    public:
+        explicit mapped(std::string const& path)
+            : file(std::make_shared<mapped_file const>(path)), row_count(0), column_count(0)
+        {
+            if(file->size() < sizeof(impl::header)){
+                throw("gene::dataset::mapped: file too small.");
+            }
+            impl::header h;
+            std::memcpy(&h, file->data(), sizeof(h));
+            if(std::memcmp(h.magic, impl::magic, sizeof(h.magic)) != 0){
+                throw("gene::dataset::mapped: not a dataset file.");
+            }
+            if(h.byte_order_mark != impl::byte_order_mark){
+                throw("gene::dataset::mapped: written with another byte order.");
+            }
+            if(h.version != format_version){
+                throw("gene::dataset::mapped: unsupported format version.");
+            }
+            if(h.value_size != sizeof(ValueType)){
+                throw("gene::dataset::mapped: value type size mismatch.");
+            }
+            if(h.rows > file->size() || h.columns > file->size()
+               || impl::column_offset<ValueType>(h.rows, h.columns) > file->size()){
+                throw("gene::dataset::mapped: file is truncated.");
+            }
+            row_count = h.rows;
+            column_count = h.columns;
+        }
+
+        std::size_t rows() const
+        {
+            return row_count;
+        }
+
+        std::size_t size() const
+        {
+            return column_count;
+        }
+
+        ValueType const* column(std::size_t const i) const
+        {
+            return reinterpret_cast<ValueType const*>(file->data() + impl::column_offset<ValueType>(row_count, i));
+        }
+
+        // columns [first, first + count), all rows
+        batch::columns<ValueType> columns(std::size_t const first, std::size_t const count) const
+        {
+            if(first + count > column_count){
+                throw("gene::dataset::mapped::columns: columns out of range.");
+            }
+            std::vector<ValueType const*> ptrs;
+            for(std::size_t i = first; i < first + count; ++i){
+                ptrs.push_back(column(i));
+            }
+            return batch::columns<ValueType>::view(std::move(ptrs), row_count, file);
+        }
+
+        // lets the system drop the pages of rows [first, first + count)
+        void release(std::size_t const first, std::size_t const count) const
+        {
+            for(std::size_t c = 0; c < column_count; ++c){
+                file->release(impl::column_offset<ValueType>(row_count, c) + first * sizeof(ValueType),
+                              count * sizeof(ValueType));
+            }
+        }
+
+        // Calls f(chunk, first_row) for consecutive chunks of chunk_rows rows
+        // of all columns, releasing each chunk's pages afterwards, so a file
+        // larger than memory can be scanned with a bounded working set.
+        template<class F>
+        void for_each_chunk(F f, std::size_t chunk_rows = config::dataset_chunk_rows) const
+        {
+            chunk_rows = std::max<std::size_t>(chunk_rows, 1);
+            auto const all = columns(0, column_count);
+            for(std::size_t first = 0; first < row_count; first += chunk_rows){
+                std::size_t const n = std::min(chunk_rows, row_count - first);
+                f(all.slice(first, n), first);
+                release(first, n);
+            }
+        }
+    };
+
+} // namespace dataset
+
+} // namespace gene
+
+#endif    // GENE_DATASET_HPP_INCLUDED
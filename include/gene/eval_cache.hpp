@@ -0,0 +1,385 @@
+#if !defined GENE_EVAL_CACHE_HPP_INCLUDED
+#define      GENE_EVAL_CACHE_HPP_INCLUDED
+
+#include "config.hpp"
+#include "node.hpp"
+#include "operators.hpp"
+#include "flat_tree.hpp"
+#include "batch.hpp"
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <cstddef>
+
+namespace gene {
+
+namespace batch {
+
+    // Output columns of subtrees over the current training data, keyed by
+    // structural hash and shared by every individual of a population.
+    // Least recently used entries are evicted to stay within the byte budget.
+    // Keys are verified structurally, so hash collisions cannot return a
+    // wrong column. The cache must be cleared when the training data changes.
+    // A subtree is only worth storing once it has missed twice (see
+    // find()), so subtrees seen once, most of them, cost no more than
+    // without the cache.
+    template<class ValueType>
+    class subtree_cache{
+    public:
+        typedef std::shared_ptr<std::vector<ValueType> const> column_ptr;
+        typedef tree::flat_tree<ValueType> key_type;
+
+        struct statistics{
+            std::size_t hits;
+            std::size_t misses;
+            std::size_t evictions;
+            std::size_t entries;
+            std::size_t bytes;
+
+            double hit_rate() const
+            {
+                return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+            }
+        };
+
+    private:
+        struct entry{
+            std::size_t hash;
+            key_type key;
+            column_ptr column;
+            std::size_t bytes;
+        };
+        typedef std::list<entry> entries_type;
+
+        mutable std::mutex mutex;
+        entries_type entries;   // most recently used first
+        std::unordered_multimap<std::size_t, typename entries_type::iterator> index;
+        std::unordered_set<std::size_t> missed;    // hashes that missed once, forgotten in bulk
+        std::size_t budget;
+        std::size_t used;
+        static constexpr std::size_t max_missed = 1 << 16;
+        std::size_t hits;
+        std::size_t misses;
+        std::size_t evictions;
+
+        static std::size_t bytes_of(key_type const& key, std::vector<ValueType> const& column)
+        {
+            return column.size() * sizeof(ValueType)
+                 + key.size() * sizeof(tree::flat_node)
+                 + key.constant_pool().size() * sizeof(ValueType)
+                 + sizeof(entry);
+        }
+
+        // true if key is the size nodes at code, whose constants index
+        // into constants
+        static bool same(key_type const& key, tree::flat_node const* code, std::size_t const size, ValueType const* constants)
+        {
+            if(key.size() != size){
+                return false;
+            }
+            auto const& key_code = key.code();
+            for(std::size_t i = 0; i < size; ++i){
+                tree::flat_node const& a = key_code[i];
+                tree::flat_node const& b = code[i];
+                if(a.kind != b.kind){
+                    return false;
+                }
+                if(a.kind == tree::constant_value ? !(key.constant_pool()[a.payload] == constants[b.payload]) : a.payload != b.payload){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        typename entries_type::iterator lookup_locked(std::size_t const hash, tree::flat_node const* code,
+                                                      std::size_t const size, ValueType const* constants)
+        {
+            auto const range = index.equal_range(hash);
+            for(auto i = range.first; i != range.second; ++i){
+                if(same(i->second->key, code, size, constants)){
+                    return i->second;
+                }
+            }
+            return entries.end();
+        }
+
+        typename entries_type::iterator lookup_locked(std::size_t const hash, key_type const& key)
+        {
+            return lookup_locked(hash, key.code().data(), key.size(), key.constant_pool().data());
+        }
+
+        void evict_locked()
+        {
+            while(used > budget && !entries.empty()){
+                auto const last = std::prev(entries.end());
+                auto const range = index.equal_range(last->hash);
+                for(auto i = range.first; i != range.second; ++i){
+                    if(i->second == last){
+                        index.erase(i);
+                        break;
+                    }
+                }
+                used -= last->bytes;
+                entries.erase(last);
+                ++evictions;
+            }
+        }
+
+    public:
+        explicit subtree_cache(std::size_t const budget_bytes = config::eval_cache_bytes)
+            : mutex(), entries(), index(), missed(), budget(budget_bytes), used(0), hits(0), misses(0), evictions(0)
+        {}
+
+        subtree_cache(subtree_cache const&) = delete;
+        subtree_cache& operator=(subtree_cache const&) = delete;
+
+        // the cached column, or null
+        column_ptr find(std::size_t const hash, key_type const& key)
+        {
+            bool admit;
+            return find(hash, key.code().data(), key.size(), key.constant_pool().data(), 0, admit);
+        }
+
+        // the cached column of the subtree made of the size nodes at code,
+        // whose constants index into constants, e.g. a span of a larger
+        // flat tree; or null. No key is built. On a miss, admit tells
+        // whether a column of rows values for the subtree is worth
+        // inserting: it missed before and fits the budget.
+        column_ptr find(std::size_t const hash, tree::flat_node const* code, std::size_t const size, ValueType const* constants,
+                        std::size_t const rows, bool &admit)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto const i = lookup_locked(hash, code, size, constants);
+            if(i == entries.end()){
+                ++misses;
+                if(missed.size() >= max_missed){
+                    missed.clear();
+                }
+                admit = !missed.insert(hash).second
+                     && rows * sizeof(ValueType) + size * sizeof(tree::flat_node) + sizeof(entry) <= budget;
+                return nullptr;
+            }
+            ++hits;
+            entries.splice(entries.begin(), entries, i);
+            return i->column;
+        }
+
+        void insert(std::size_t const hash, key_type key, column_ptr column)
+        {
+            std::size_t const bytes = bytes_of(key, *column);
+            if(bytes > budget){
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if(lookup_locked(hash, key) != entries.end()){
+                return;
+            }
+            entries.push_front(entry{hash, std::move(key), std::move(column), bytes});
+            index.emplace(hash, entries.begin());
+            used += bytes;
+            evict_locked();
+        }
+
+        void set_budget(std::size_t const budget_bytes)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            budget = budget_bytes;
+            evict_locked();
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.clear();
+            index.clear();
+            missed.clear();
+            used = 0;
+        }
+
+        statistics stats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return {hits, misses, evictions, entries.size(), used};
+        }
+
+        void reset_statistics()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            hits = misses = evictions = 0;
+        }
+    };
+
+    // Evaluates a flat tree one whole column at a time, taking the columns of
+    // subtrees of at least min_nodes nodes from the cache and storing the
+    // ones the cache admits. Lookups compare the subtree in place, and only
+    // a column about to be stored is allocated: constants and the columns of
+    // smaller subtrees go to scratch columns reused from call to call, so
+    // keep the evaluator around, e.g. that of thread_evaluator().
+    template<class ValueType>
+    class cached_evaluator{
+    private:
+        typedef typename subtree_cache<ValueType>::column_ptr column_ptr;
+        typedef typename subtree_cache<ValueType>::key_type key_type;
+
+        static constexpr std::size_t no_scratch = static_cast<std::size_t>(-1);
+
+        struct column_ref{
+            ValueType const* data;
+            column_ptr owner;       // set for cached columns
+            std::size_t scratch;    // index in scratch, or no_scratch
+        };
+
+        subtree_cache<ValueType>* cache;
+        std::size_t min_nodes;
+        std::vector<std::vector<ValueType>> scratch;
+        std::vector<std::size_t> free_scratch;
+        std::vector<std::size_t> ends;
+
+        template<class FlatTree>
+        struct context{
+            FlatTree const& t;
+            std::vector<std::size_t> hashes;
+            ValueType const* const* columns;
+            std::size_t rows;
+        };
+
+        template<class Primitives>
+        void subtree_ends(std::vector<tree::flat_node> const& code)
+        {
+            ends.resize(code.size());
+            std::vector<std::size_t> stack;
+            for(std::size_t i = code.size(); i-- > 0;){
+                ends[i] = i + 1;
+                for(std::size_t c = 0; c < tree::arity_of<Primitives>(code[i]); ++c){
+                    ends[i] = stack.back();
+                    stack.pop_back();
+                }
+                stack.push_back(ends[i]);
+            }
+        }
+
+        std::size_t acquire(std::size_t const rows)
+        {
+            std::size_t i;
+            if(free_scratch.empty()){
+                i = scratch.size();
+                scratch.emplace_back();
+            }else{
+                i = free_scratch.back();
+                free_scratch.pop_back();
+            }
+            if(scratch[i].size() < rows){
+                scratch[i].resize(rows);
+            }
+            return i;
+        }
+
+        void release(column_ref const& ref)
+        {
+            if(ref.scratch != no_scratch){
+                free_scratch.push_back(ref.scratch);
+            }
+        }
+
+        template<class FlatTree>
+        column_ref eval(context<FlatTree> const& ctx, std::size_t const pos)
+        {
+            auto const& code = ctx.t.code();
+            auto const& n = code[pos];
+            if(n.kind == tree::constant_value){
+                std::size_t const s = acquire(ctx.rows);
+                std::fill(scratch[s].begin(), scratch[s].begin() + ctx.rows, ctx.t.constant_pool()[n.payload]);
+                return {scratch[s].data(), nullptr, s};
+            }else if(n.kind == tree::variable_value){
+                return {ctx.columns[n.payload], nullptr, no_scratch};
+            }
+
+            bool cacheable = ends[pos] - pos >= min_nodes;
+            if(cacheable){
+                if(auto const hit = cache->find(ctx.hashes[pos], code.data() + pos, ends[pos] - pos, ctx.t.constant_pool().data(),
+                                               ctx.rows, cacheable)){
+                    return {hit->data(), hit, no_scratch};
+                }
+            }
+
+            typedef typename FlatTree::primitives_type primitives;
+            auto const arity = primitives::arity(n.payload);
+            column_ref args[primitives::max_arity];
+            ValueType const* arg_ptrs[primitives::max_arity];
+            for(std::size_t c = 0, child = pos + 1; c < arity; ++c, child = ends[child]){
+                args[c] = eval(ctx, child);
+                arg_ptrs[c] = args[c].data;
+            }
+            std::shared_ptr<std::vector<ValueType>> owned;
+            std::size_t s = no_scratch;
+            ValueType* target;
+            if(cacheable){
+                owned = std::make_shared<std::vector<ValueType>>(ctx.rows);
+                target = owned->data();
+            }else{
+                s = acquire(ctx.rows);
+                target = scratch[s].data();
+            }
+            primitives::kernel(n.payload, target, arg_ptrs, ctx.rows);
+            for(std::size_t c = 0; c < arity; ++c){
+                release(args[c]);
+            }
+            if(cacheable){
+                auto const sub = ctx.t.subtree(pos);
+                cache->insert(ctx.hashes[pos], key_type(sub.code(), sub.constant_pool()), owned);
+            }
+            return {target, owned, s};
+        }
+
+    public:
+        explicit cached_evaluator(subtree_cache<ValueType> &cache_, std::size_t const min_nodes_ = config::eval_cache_min_nodes)
+            : cache(&cache_), min_nodes(min_nodes_), scratch(), free_scratch(), ends()
+        {}
+
+        // uses cache from now on, keeping the scratch columns
+        void bind(subtree_cache<ValueType> &cache_)
+        {
+            cache = &cache_;
+        }
+
+        template<class RandomTermGen, class Primitives>
+        void operator()(tree::flat_tree<ValueType, RandomTermGen, Primitives> const& t,
+                        ValueType const* const* columns,
+                        std::size_t const rows,
+                        ValueType* out)
+        {
+            typedef tree::flat_tree<ValueType, RandomTermGen, Primitives> flat_tree_type;
+            subtree_ends<Primitives>(t.code());
+            context<flat_tree_type> const ctx{t, t.hashes(), columns, rows};
+            auto const result = eval(ctx, 0);
+            std::copy(result.data, result.data + rows, out);
+            release(result);
+        }
+    };
+
+    // The calling thread's evaluator, bound to cache, so that threads
+    // evaluating many trees allocate their scratch columns once.
+    template<class ValueType>
+    cached_evaluator<ValueType>& thread_evaluator(subtree_cache<ValueType> &cache)
+    {
+        static thread_local cached_evaluator<ValueType> evaluator(cache);
+        evaluator.bind(cache);
+        return evaluator;
+    }
+
+    template<class ValueType>
+    constexpr std::size_t subtree_cache<ValueType>::max_missed;
+
+    template<class ValueType>
+    constexpr std::size_t cached_evaluator<ValueType>::no_scratch;
+
+} // namespace batch
+
+} // namespace gene
+
+#endif    // GENE_EVAL_CACHE_HPP_INCLUDED
@@ -0,0 +1,117 @@
+#if !defined GENE_FITNESS_TABLE_HPP_INCLUDED
+#define      GENE_FITNESS_TABLE_HPP_INCLUDED
+
+#include "config.hpp"
+
+#include <unordered_map>
+#include <list>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <cstddef>
+
+namespace gene {
+
+    // Fitness of already evaluated individuals, found by individual::hash()
+    // and checked against a Key compared with KeyEqual (e.g. the flat trees,
+    // see individual::same_structure), so duplicates and re-created
+    // individuals are not evaluated again and hash collisions cannot return
+    // another individual's fitness. Valid for one training set only; clear()
+    // it when the data changes. Beyond capacity entries, the least recently
+    // used are evicted one by one.
+    template<class ValueType, class Key = std::size_t, class KeyEqual = std::equal_to<Key>>
+    class fitness_table{
+    public:
+        struct statistics{
+            std::size_t lookups;
+            std::size_t hits;
+            std::size_t entries;
+
+            double hit_rate() const
+            {
+                return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+            }
+        };
+
+    private:
+        struct entry{
+            std::size_t hash;
+            Key key;
+            ValueType fitness;
+        };
+        typedef std::list<entry> entries_type;
+
+        mutable std::mutex mutex;
+        entries_type entries;   // most recently used first
+        std::unordered_map<std::size_t, typename entries_type::iterator> index;
+        std::size_t capacity;
+        std::size_t lookups;
+        std::size_t hits;
+
+    public:
+        explicit fitness_table(std::size_t const capacity_ = config::fitness_table_size)
+            : mutex(), entries(), index(), capacity(capacity_), lookups(0), hits(0)
+        {}
+
+        fitness_table(fitness_table const&) = delete;
+        fitness_table& operator=(fitness_table const&) = delete;
+
+        bool find(std::size_t const hash, Key const& key, ValueType &fitness)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++lookups;
+            auto const i = index.find(hash);
+            if(i == index.end() || !KeyEqual()(i->second->key, key)){
+                return false;
+            }
+            ++hits;
+            entries.splice(entries.begin(), entries, i->second);
+            fitness = i->second->fitness;
+            return true;
+        }
+
+        // a colliding entry of another key is replaced
+        void insert(std::size_t const hash, Key const& key, ValueType const fitness)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(capacity == 0){
+                return;
+            }
+            auto const i = index.find(hash);
+            if(i != index.end()){
+                i->second->key = key;
+                i->second->fitness = fitness;
+                entries.splice(entries.begin(), entries, i->second);
+                return;
+            }
+            entries.push_front(entry{hash, key, fitness});
+            index.emplace(hash, entries.begin());
+            if(entries.size() > capacity){
+                index.erase(entries.back().hash);
+                entries.pop_back();
+            }
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.clear();
+            index.clear();
+        }
+
+        statistics stats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return {lookups, hits, entries.size()};
+        }
+
+        void reset_statistics()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            lookups = hits = 0;
+        }
+    };
+
+} // namespace gene
+
+#endif    // GENE_FITNESS_TABLE_HPP_INCLUDED
@@ -0,0 +1,351 @@
+#if !defined GENE_FLAT_TREE_HPP_INCLUDED
+#define      GENE_FLAT_TREE_HPP_INCLUDED
+
+#include "config.hpp"
+#include "random.hpp"
+#include "node.hpp"
+#include "hashcons.hpp"
+#include "operators.hpp"
+#include "random_term.hpp"
+#include "tree.hpp"
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/lexical_cast.hpp>
+
+namespace gene {
+
+namespace tree {
+
+    // A node of flat_tree.
+    // kind is one of node_property. payload is an index into the constant pool
+    // for constant_value, the variable number for variable_value and the index
+    // of the operator in the primitive set for knot_value.
+    struct flat_node{
+        std::uint32_t kind;
+        std::uint32_t payload;
+    };
+
+    template<class Primitives = operators::default_primitives>
+    inline std::size_t arity_of(flat_node const& n)
+    {
+        return n.kind == knot_value ? Primitives::arity(n.payload) : 0;
+    }
+
+    // Tree stored as a contiguous prefix (pre-order) array of flat_node.
+    // Every subtree is the contiguous range [i, subtree_end(i)), so copying a
+    // tree is a copy of two vectors and no node is shared between copies.
+    // Individuals still breed tree, which enforces the size and depth
+    // limits; flat_tree is the form trees are evaluated and compiled in
+    // (see flatten()).
+    template< class ValueType,
+              class RandomTermGenerator = random_term::default_random_term<ValueType>,
+              class Primitives = operators::default_primitives >
+    class flat_tree{
+    public:
+        typedef std::vector<flat_node> nodes_type;
+        typedef std::vector<ValueType> constants_type;
+        typedef Primitives primitives_type;
+
+    private:
+        nodes_type nodes;
+        constants_type constants;
+
+    private:
+        std::string expression_impl(std::size_t &pos) const
+        {
+            flat_node const& n = nodes[pos++];
+            if(n.kind == constant_value){
+                return boost::lexical_cast<std::string>(constants[n.payload]);
+            }else if(n.kind == knot_value){
+                std::vector<std::string> arg_strs(Primitives::arity(n.payload));
+                for(auto &s : arg_strs){
+                    s = expression_impl(pos);
+                }
+                return Primitives::to_string(n.payload, arg_strs);
+            }else if(n.kind == variable_value){
+                return variable_name(n.payload);
+            }else{
+                throw("gene::tree::flat_tree::expression_impl: invalid node value.");
+            }
+        }
+
+        std::string indent(int const level) const
+        {
+            return std::string(level * config::indent_width, ' ');
+        }
+
+        std::string to_string_impl(std::size_t &pos, int const level) const
+        {
+            flat_node const& n = nodes[pos++];
+            if(n.kind == constant_value){
+                return indent(level) + "const: "
+                    + boost::lexical_cast<std::string>(constants[n.payload]) + '\n';
+            }else if(n.kind == knot_value){
+                std::string retval = indent(level) + Primitives::symbol(n.payload) + ":\n";
+                for(std::size_t i = 0; i < Primitives::arity(n.payload); ++i){
+                    retval += to_string_impl(pos, level+1) + '\n';
+                }
+                return retval;
+            }else if(n.kind == variable_value){
+                return indent(level) + "var: " + variable_name(n.payload);
+            }else{
+                throw("gene::tree::flat_tree::to_string_impl: invalid node value.");
+            }
+        }
+
+        template<std::size_t InputSize>
+        ValueType value_impl(std::size_t &pos, std::array<ValueType, InputSize> const& variable_values) const
+        {
+            flat_node const& n = nodes[pos++];
+            if(n.kind == constant_value){
+                return constants[n.payload];
+            }else if(n.kind == knot_value){
+                ValueType args[Primitives::max_arity];
+                for(std::size_t i = 0; i < Primitives::arity(n.payload); ++i){
+                    args[i] = value_impl(pos, variable_values);
+                }
+                return Primitives::template apply<ValueType>(n.payload, args);
+            }else if(n.kind == variable_value){
+                return variable_values[n.payload];
+            }else{
+                throw("gene::tree::flat_tree::value_impl: invalid node value.");
+            }
+        }
+
+        std::size_t depth_impl(std::size_t &pos) const
+        {
+            flat_node const& n = nodes[pos++];
+            std::size_t depth = 0;
+            if(n.kind == knot_value){
+                for(std::size_t i = 0; i < Primitives::arity(n.payload); ++i){
+                    auto const d = depth_impl(pos) + 1;
+                    depth = depth < d ? d : depth;
+                }
+            }
+            return depth;
+        }
+
+        void push_range(flat_tree const& src, std::size_t first, std::size_t const last)
+        {
+            for(; first != last; ++first){
+                flat_node n = src.nodes[first];
+                if(n.kind == constant_value){
+                    constants.push_back(src.constants[n.payload]);
+                    n.payload = static_cast<std::uint32_t>(constants.size() - 1);
+                }
+                nodes.push_back(n);
+            }
+        }
+
+    public:
+        flat_tree() : nodes(), constants() {}
+        flat_tree(nodes_type nodes_, constants_type constants_)
+            : nodes(std::move(nodes_)), constants(std::move(constants_))
+        {}
+
+        std::string expression() const
+        {
+            std::size_t pos = 0;
+            return expression_impl(pos);
+        }
+
+        std::string to_string() const
+        {
+            std::size_t pos = 0;
+            return to_string_impl(pos, 0);
+        }
+
+        template<std::size_t InputSize>
+        ValueType value(std::array<ValueType, InputSize> const& variable_values) const
+        {
+            std::size_t pos = 0;
+            return value_impl(pos, variable_values);
+        }
+
+        std::size_t depth() const
+        {
+            std::size_t pos = 0;
+            return depth_impl(pos);
+        }
+
+        std::size_t size() const
+        {
+            return nodes.size();
+        }
+
+        // index of a node chosen uniformly at random
+        std::size_t anywhere() const
+        {
+            return random::uniform_index(nodes.size());
+        }
+
+        // one past the last node of the subtree rooted at pos
+        std::size_t subtree_end(std::size_t pos) const
+        {
+            std::size_t open = 1;
+            while(open != 0){
+                open += arity_of<Primitives>(nodes[pos++]);
+                --open;
+            }
+            return pos;
+        }
+
+        flat_tree subtree(std::size_t const pos) const
+        {
+            flat_tree retval;
+            retval.push_range(*this, pos, subtree_end(pos));
+            return retval;
+        }
+
+        // replaces the subtree rooted at pos with the whole of replacement
+        void replace(std::size_t const pos, flat_tree const& replacement)
+        {
+            flat_tree result;
+            result.nodes.reserve(nodes.size() + replacement.nodes.size());
+            auto const last = subtree_end(pos);
+            result.push_range(*this, 0, pos);
+            result.push_range(replacement, 0, replacement.nodes.size());
+            result.push_range(*this, last, nodes.size());
+            swap(result);
+        }
+
+        // structural hash of the subtree rooted at every node, in node order;
+        // equal to node_hash() of the corresponding tree nodes
+        std::vector<std::size_t> hashes() const
+        {
+            std::vector<std::size_t> retval(nodes.size());
+            std::vector<std::size_t> stack;
+            for(std::size_t i = nodes.size(); i-- > 0;){
+                flat_node const& n = nodes[i];
+                if(n.kind == constant_value){
+                    retval[i] = constant_hash(constants[n.payload]);
+                }else if(n.kind == variable_value){
+                    retval[i] = variable_hash(n.payload);
+                }else{
+                    std::size_t h = knot_hash_seed(n.payload);
+                    for(std::size_t c = 0; c < Primitives::arity(n.payload); ++c){
+                        h = hash::combine(h, stack.back());
+                        stack.pop_back();
+                    }
+                    retval[i] = h;
+                }
+                stack.push_back(retval[i]);
+            }
+            return retval;
+        }
+
+        // structural equality; constants are compared by value
+        bool operator==(flat_tree const& other) const
+        {
+            if(nodes.size() != other.nodes.size()){
+                return false;
+            }
+            for(std::size_t i = 0; i < nodes.size(); ++i){
+                flat_node const& a = nodes[i];
+                flat_node const& b = other.nodes[i];
+                if(a.kind != b.kind){
+                    return false;
+                }
+                if(a.kind == constant_value ? !(constants[a.payload] == other.constants[b.payload]) : a.payload != b.payload){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool operator!=(flat_tree const& other) const
+        {
+            return !(*this == other);
+        }
+
+        void swap(flat_tree &other)
+        {
+            nodes.swap(other.nodes);
+            constants.swap(other.constants);
+        }
+
+        nodes_type const& code() const
+        {
+            return nodes;
+        }
+
+        constants_type const& constant_pool() const
+        {
+            return constants;
+        }
+    };
+
+    namespace impl {
+
+        template<class ValueType>
+        void flatten_impl(std::shared_ptr<node<ValueType>> const& node_ptr,
+                          std::vector<flat_node> &nodes,
+                          std::vector<ValueType> &constants)
+        {
+            auto const which = node_ptr->which();
+            if(which == constant_value){
+                constants.push_back(boost::get<ValueType>(*node_ptr));
+                nodes.push_back({constant_value, static_cast<std::uint32_t>(constants.size() - 1)});
+            }else if(which == knot_value){
+                auto const& knot_node = boost::get<knot<ValueType>>(*node_ptr);
+                nodes.push_back({knot_value, static_cast<std::uint32_t>(knot_node.op)});
+                for(auto const& child : knot_node.children){
+                    flatten_impl(child, nodes, constants);
+                }
+            }else if(which == variable_value){
+                nodes.push_back({variable_value, static_cast<std::uint32_t>(boost::get<Variable>(*node_ptr))});
+            }else{
+                throw("gene::tree::flatten_impl: invalid node value.");
+            }
+        }
+
+        template<class Primitives, class ValueType>
+        std::shared_ptr<node<ValueType>> unflatten_impl(std::vector<flat_node> const& nodes,
+                                                        std::vector<ValueType> const& constants,
+                                                        std::size_t &pos)
+        {
+            flat_node const& n = nodes[pos++];
+            if(n.kind == constant_value){
+                return make_node<ValueType>(constants[n.payload]);
+            }else if(n.kind == knot_value){
+                knot<ValueType> knot_node(n.payload, Primitives::arity(n.payload));
+                for(std::size_t i = 0; i < knot_node.arity; ++i){
+                    knot_node.children.push_back(unflatten_impl<Primitives>(nodes, constants, pos));
+                }
+                return make_node<ValueType>(std::move(knot_node));
+            }else if(n.kind == variable_value){
+                return make_node<ValueType>(Variable(n.payload));
+            }else{
+                throw("gene::tree::unflatten_impl: invalid node value.");
+            }
+        }
+
+    } // namespace impl
+
+    template<class ValueType, class RandomTermGen, class Primitives>
+    inline flat_tree<ValueType, RandomTermGen, Primitives> flatten(tree<ValueType, RandomTermGen, Primitives> const& t)
+    {
+        std::vector<flat_node> nodes;
+        std::vector<ValueType> constants;
+        impl::flatten_impl(t.root_node(), nodes, constants);
+        return {std::move(nodes), std::move(constants)};
+    }
+
+    template<class ValueType, class RandomTermGen, class Primitives>
+    inline tree<ValueType, RandomTermGen, Primitives> unflatten(flat_tree<ValueType, RandomTermGen, Primitives> const& t)
+    {
+        std::size_t pos = 0;
+        return {impl::unflatten_impl<Primitives>(t.code(), t.constant_pool(), pos)};
+    }
+
+} // namespace tree
+
+} // namespace gene
+
+#endif    // GENE_FLAT_TREE_HPP_INCLUDED
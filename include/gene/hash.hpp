@@ -0,0 +1,62 @@
+#if !defined GENE_HASH_HPP_INCLUDED
+#define      GENE_HASH_HPP_INCLUDED
+
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace gene {
+
+namespace hash {
+
+    // finalizer of splitmix64: every bit of x affects every bit of the result
+    inline std::size_t mix(std::size_t const x)
+    {
+        std::uint64_t z = static_cast<std::uint64_t>(x);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return static_cast<std::size_t>(z ^ (z >> 31));
+    }
+
+    inline std::size_t combine(std::size_t const seed, std::size_t const value)
+    {
+        return mix(seed ^ (value + static_cast<std::size_t>(0x9e3779b97f4a7c15ULL) + (seed << 6) + (seed >> 2)));
+    }
+
+    template<class T>
+    inline std::size_t value(T const& v)
+    {
+        return std::hash<T>()(v);
+    }
+
+    // Hash of v rounded to bits significant bits, so that values differing
+    // only in the bits dropped mostly share it. Both zeros share one, as do
+    // all NaNs; values either side of a rounding boundary do not.
+    template<class T>
+    inline std::size_t quantized(T const v, int bits)
+    {
+        if(std::isnan(v)){
+            return value(static_cast<std::size_t>(1));
+        }
+        if(v == T(0) || std::isinf(v)){
+            return value(v);
+        }
+        bits = std::min(std::max(bits, 1), std::numeric_limits<T>::digits);
+        int exponent;
+        T const mantissa = std::frexp(v, &exponent);    // in [0.5, 1)
+        long long rounded = std::llround(std::ldexp(mantissa, bits));
+        if(rounded == (1LL << bits) || rounded == -(1LL << bits)){
+            rounded /= 2;
+            ++exponent;
+        }
+        return combine(value(exponent), value(rounded));
+    }
+
+} // namespace hash
+
+} // namespace gene
+
+#endif    // GENE_HASH_HPP_INCLUDED
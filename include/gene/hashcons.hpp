@@ -0,0 +1,161 @@
+#if !defined GENE_HASHCONS_HPP_INCLUDED
+#define      GENE_HASHCONS_HPP_INCLUDED
+
+#include "node.hpp"
+#include "memory.hpp"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <cstddef>
+
+#include <boost/variant.hpp>
+
+namespace gene {
+
+namespace tree {
+
+    // Population-wide table of canonical nodes. Interning a node whose
+    // children are canonical returns the one shared node with the same
+    // structure, so every distinct subtree exists once.
+    // Nodes are never modified after construction (mutation and crossover
+    // copy the path to the root instead), which is what makes sharing safe.
+    template<class ValueType>
+    class hashcons_table{
+    public:
+        typedef std::shared_ptr<node<ValueType>> node_ptr_type;
+
+        struct statistics{
+            std::size_t lookups;
+            std::size_t hits;
+            std::size_t entries;
+        };
+
+    private:
+        mutable std::mutex mutex;
+        std::unordered_multimap<std::size_t, std::weak_ptr<node<ValueType>>> entries;
+        std::size_t lookups;
+        std::size_t hits;
+        std::size_t purge_at;
+
+        // shallow comparison: children are compared by identity
+        static bool same(node<ValueType> const& a, node<ValueType> const& b)
+        {
+            if(a.which() != b.which()){
+                return false;
+            }
+            switch(a.which()){
+            case constant_value:
+                return boost::get<ValueType>(a) == boost::get<ValueType>(b);
+            case variable_value:
+                return boost::get<Variable>(a) == boost::get<Variable>(b);
+            case knot_value:
+            {
+                auto const& ka = boost::get<knot<ValueType>>(a);
+                auto const& kb = boost::get<knot<ValueType>>(b);
+                return ka.hash == kb.hash
+                    && ka.op == kb.op
+                    && ka.children == kb.children;
+            }
+            default:
+                return false;
+            }
+        }
+
+        void purge_locked()
+        {
+            for(auto i = entries.begin(); i != entries.end();){
+                i = i->second.expired() ? entries.erase(i) : std::next(i);
+            }
+            purge_at = 2 * entries.size() + 1024;
+        }
+
+    public:
+        hashcons_table() : mutex(), entries(), lookups(0), hits(0), purge_at(1024) {}
+        hashcons_table(hashcons_table const&) = delete;
+        hashcons_table& operator=(hashcons_table const&) = delete;
+
+        node_ptr_type intern(node_ptr_type const& n)
+        {
+            auto const h = node_hash(*n);
+            std::lock_guard<std::mutex> lock(mutex);
+            ++lookups;
+            auto const range = entries.equal_range(h);
+            for(auto i = range.first; i != range.second; ++i){
+                if(auto existing = i->second.lock()){
+                    if(existing == n || same(*existing, *n)){
+                        ++hits;
+                        return existing;
+                    }
+                }
+            }
+            entries.emplace(h, n);
+            if(entries.size() >= purge_at){
+                purge_locked();
+            }
+            return n;
+        }
+
+        // drops the entries of nodes that no longer exist
+        void purge()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            purge_locked();
+        }
+
+        statistics stats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return {lookups, hits, entries.size()};
+        }
+    };
+
+    template<class ValueType>
+    hashcons_table<ValueType>*& current_table()
+    {
+        static thread_local hashcons_table<ValueType>* t = nullptr;
+        return t;
+    }
+
+    // Interns every node made with make_node on this thread while in scope.
+    template<class ValueType>
+    class scoped_table{
+    private:
+        hashcons_table<ValueType>* previous;
+
+    public:
+        explicit scoped_table(hashcons_table<ValueType> &t) : previous(current_table<ValueType>())
+        {
+            current_table<ValueType>() = &t;
+        }
+
+        scoped_table(scoped_table const&) = delete;
+        scoped_table& operator=(scoped_table const&) = delete;
+
+        ~scoped_table()
+        {
+            current_table<ValueType>() = previous;
+        }
+    };
+
+    // Allocates a node from the calling thread's current memory::resource,
+    // computes its hash and, inside a scoped_table, returns the canonical node.
+    template<class V, class... Args>
+    std::shared_ptr<node<V>> make_node(Args&&... args)
+    {
+        auto n = std::allocate_shared<node<V>>(memory::allocator<node<V>>(), std::forward<Args>(args)...);
+        if(n->which() == knot_value){
+            boost::get<knot<V>>(*n).rehash();
+        }
+        if(auto const table = current_table<V>()){
+            return table->intern(n);
+        }
+        return n;
+    }
+
+} // namespace tree
+
+} // namespace gene
+
+#endif    // GENE_HASHCONS_HPP_INCLUDED
@@ -2,12 +2,24 @@
 #define      GENE_INDIVIDUAL_HPP_INCLUDED
 
 #include "config.hpp"
+#include "hash.hpp"
 #include "tree.hpp"
+#include "flat_tree.hpp"
+#include "batch.hpp"
+#include "bytecode.hpp"
+#include "eval_cache.hpp"
+#include "simplify.hpp"
+#include "range_analysis.hpp"
+#include "autodiff.hpp"
 #include "random_term.hpp"
 
 #include <array>
+#include <memory>
+#include <vector>
 #include <string>
 #include <algorithm>
+#include <limits>
+#include <cmath>
 
 #include <boost/algorithm/string/join.hpp>
 
@@ -17,34 +29,321 @@ namespace individual {
     template< class ValueType,
               std::size_t InputSize,
               std::size_t ValueSize,
-              class RandomTermGenerator = random_term::default_random_term<ValueType> >
+              class RandomTermGenerator = random_term::default_random_term<ValueType>,
+              class Primitives = tree::operators::default_primitives >
     class individual{
 
-        template< class V, std::size_t In, std::size_t Out, class Rand>
-        friend void mutation(individual<V, In, Out, Rand> &ind);
+        template< class V, std::size_t In, std::size_t Out, class Rand, class Prims >
+        friend void mutation(individual<V, In, Out, Rand, Prims> &ind);
 
-        template< class V, std::size_t In, std::size_t VSize, class Rand >
-        friend void crossover(individual<V, In, VSize, Rand> &lhs,
-                              individual<V, In, VSize, Rand> &rhs);
+        template< class V, std::size_t In, std::size_t VSize, class Rand, class Prims >
+        friend void crossover(individual<V, In, VSize, Rand, Prims> &lhs,
+                              individual<V, In, VSize, Rand, Prims> &rhs);
 
     public:
-        typedef tree::tree<ValueType, RandomTermGenerator> tree_type;
+        typedef ValueType value_type;
+        typedef RandomTermGenerator random_term_generator;
+        typedef Primitives primitives_type;
+        static constexpr std::size_t input_size = InputSize;
+        static constexpr std::size_t output_size = ValueSize;
+        typedef tree::tree<ValueType, RandomTermGenerator, Primitives> tree_type;
         typedef std::array<tree_type, ValueSize> trees_type;
 
+        // outputs[i][r] = tree i over row r of columns, see set_native()
+        typedef void (*native_function)(ValueType const* const* columns, std::size_t rows, ValueType* const* outputs);
+
+        typedef std::array<tree::flat_tree<ValueType, RandomTermGenerator, Primitives>, ValueSize> flat_trees_type;
+
+        // the trees in prefix form, see flat_trees(); a compact key that
+        // keeps no node alive
+        typedef std::shared_ptr<flat_trees_type const> flat_key_type;
+
+        // true for structurally identical trees, e.g. to verify a match on
+        // hash() in a fitness_table
+        struct same_structure{
+            bool operator()(flat_key_type const& lhs, flat_key_type const& rhs) const
+            {
+                return *lhs == *rhs;
+            }
+        };
+
     private:
         trees_type trees;
 
+        // Forms of the trees derived on first use and dropped when the
+        // trees change. The users are const and may run on several threads
+        // at once, so the forms are published with the atomic shared_ptr
+        // operations; threads racing to build one build the same.
+        template<class T>
+        class lazy{
+        private:
+            mutable std::shared_ptr<T const> ptr;
+
+        public:
+            lazy() : ptr() {}
+            lazy(lazy const& other) : ptr(std::atomic_load(&other.ptr)) {}
+
+            lazy& operator=(lazy const& other)
+            {
+                std::atomic_store(&ptr, std::atomic_load(&other.ptr));
+                return *this;
+            }
+
+            void reset()
+            {
+                std::atomic_store(&ptr, std::shared_ptr<T const>());
+            }
+
+            // build(T &) fills in a default-constructed T
+            template<class Build>
+            std::shared_ptr<T const> get(Build build) const
+            {
+                auto p = std::atomic_load(&ptr);
+                if(!p){
+                    auto built = std::make_shared<T>();
+                    build(*built);
+                    p = std::move(built);
+                    std::atomic_store(&ptr, p);
+                }
+                return p;
+            }
+        };
+
+        typedef std::array<bytecode::program<ValueType>, ValueSize> programs_type;
+
+        lazy<programs_type> programs;   // for value()
+        lazy<flat_trees_type> flats;    // for batch evaluation
+
+        // machine code of the trees, and what keeps it loaded
+        native_function native;
+        std::shared_ptr<void const> native_owner;
+
+        // combined structural hash of the trees, whether fitness is stale,
+        // whether it is only a lower bound left by an aborted evaluation,
+        // and whether the constants were fitted since the trees last changed
+        std::size_t structural_hash;
+        bool dirty;
+        bool rejected;
+        bool tuned;
+
+        // hash of the outputs on the probe rows, see fingerprint()
+        std::size_t semantic_hash;
+        bool fingerprinted;
+
+        void rehash()
+        {
+            structural_hash = hash::value(ValueSize);
+            for(auto const& t : trees){
+                structural_hash = hash::combine(structural_hash, t.hash());
+            }
+        }
+
+        void drop_native()
+        {
+            native = nullptr;
+            native_owner.reset();
+        }
+
+        void invalidate()
+        {
+            programs.reset();
+            flats.reset();
+            drop_native();
+            dirty = true;
+            tuned = false;
+            fingerprinted = false;
+            rehash();
+        }
+
     public:
         ValueType fitness;
 
     public:
-        individual(trees_type const& trees_) : trees(trees_), fitness() {}
-        individual() : fitness()
+        individual(trees_type const& trees_)
+            : trees(trees_), programs(), flats(), native(nullptr), native_owner(),
+              structural_hash(0), dirty(true), rejected(false), tuned(false),
+              semantic_hash(0), fingerprinted(false), fitness()
+        {
+            rehash();
+        }
+        individual()
+            : programs(), flats(), native(nullptr), native_owner(),
+              structural_hash(0), dirty(true), rejected(false), tuned(false),
+              semantic_hash(0), fingerprinted(false), fitness()
         {
             for(auto &t : trees)
             {
-                t = tree::generate_random<ValueType, InputSize, RandomTermGenerator>(config::random_tree_depth);
+                t = tree::generate_random<ValueType, InputSize, RandomTermGenerator, Primitives>(config::random_tree_depth);
+            }
+            rehash();
+        }
+
+        // Equal for structurally identical individuals, whichever nodes they
+        // are built from. Kept up to date by mutation and crossover in O(1)
+        // per tree, since every knot stores the hash of its subtree.
+        std::size_t hash() const
+        {
+            return structural_hash;
+        }
+
+        // the trees in prefix form, flattened once until they change
+        flat_key_type flat_trees() const
+        {
+            return flats.get([this](flat_trees_type &built){
+                for(std::size_t i = 0; i < ValueSize; ++i){
+                    built[i] = tree::flatten(trees[i]);
+                }
+            });
+        }
+
+        // Hash of the outputs over probes, each rounded to
+        // config::semantic_precision_bits significant bits (see
+        // hash::quantized), so that individuals computing the same function,
+        // e.g. x0 * 2 and x0 + x0, mostly share it whatever their structure.
+        // Kept until the trees change or the fitness is made stale, which
+        // is also when the probes may change.
+        std::size_t fingerprint(batch::columns<ValueType> const& probes)
+        {
+            if(!fingerprinted){
+                auto const outputs = values(probes);
+                semantic_hash = hash::value(probes.rows());
+                for(auto const& column : outputs){
+                    for(auto const v : column){
+                        semantic_hash = hash::combine(semantic_hash, hash::quantized(v, config::semantic_precision_bits));
+                    }
+                }
+                fingerprinted = true;
+            }
+            return semantic_hash;
+        }
+
+        // true until fitness has been computed for the current trees
+        bool needs_evaluation() const
+        {
+            return dirty;
+        }
+
+        // Simplifies every tree (see tree::simplify) and returns the number
+        // of nodes removed. A changed individual needs evaluation again:
+        // the annihilators assume finite operands, so e.g. sqrt( x0 - 5 ) * 0
+        // becomes 0 and no longer gives NaN for x0 < 5.
+        std::size_t simplify()
+        {
+            std::size_t removed = 0;
+            bool changed = false;
+            for(auto &t : trees){
+                auto const before = t.root_node();
+                removed += tree::simplify(t);
+                changed = changed || t.root_node() != before;
+            }
+            if(changed){
+                invalidate();
             }
+            return removed;
+        }
+
+        // Folds every subtree constant while the inputs stay in ranges (see
+        // tree::fold_invariants) and returns the number of nodes removed.
+        // A changed individual needs evaluation again, since the folded
+        // trees may differ outside ranges and in the sign of zeros.
+        std::size_t fold_invariants(std::vector<intervals::interval<ValueType>> const& ranges)
+        {
+            std::size_t removed = 0;
+            for(auto &t : trees){
+                removed += tree::fold_invariants(t, ranges);
+            }
+            if(removed != 0){
+                invalidate();
+            }
+            return removed;
+        }
+
+        // true if some tree is undefined (inf or NaN) for every input in
+        // ranges, or, if possibly, may be undefined for some of them
+        bool undefined_over(std::vector<intervals::interval<ValueType>> const& ranges, bool const possibly) const
+        {
+            for(auto const& t : trees){
+                auto const r = tree::range(t, ranges);
+                if(r.undefined || (possibly && r.maybe_undefined)){
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Fits the constants of every tree to its output column over inputs
+        // (see autodiff::fit_constants), then computes the fitness on them.
+        // Returns the number of trees whose constants changed.
+        std::size_t tune_constants(batch::columns<ValueType> const& inputs,
+                                   batch::columns<ValueType> const& outputs,
+                                   std::size_t const iterations)
+        {
+            auto const ptrs = inputs.pointers();
+            std::size_t changed = 0;
+            auto const forms = flat_trees();
+            for(std::size_t i = 0; i < ValueSize; ++i){
+                auto flat = (*forms)[i];
+                if(flat.constant_pool().empty()){
+                    continue;
+                }
+                auto const before = flat.constant_pool();
+                autodiff::fit_constants(flat, ptrs.data(), inputs.rows(), outputs.column(i), iterations);
+                if(flat.constant_pool() != before){
+                    trees[i] = tree::unflatten(flat);
+                    ++changed;
+                }
+            }
+            if(changed != 0){
+                invalidate();
+            }
+            tuned = true;
+            calc_fitness(inputs, outputs);
+            return changed;
+        }
+
+        // true if tune_constants() ran since the trees last changed
+        bool constants_tuned() const
+        {
+            return tuned;
+        }
+
+        // true if the last evaluation stopped at its bound, see calc_fitness_bounded()
+        bool is_rejected() const
+        {
+            return rejected;
+        }
+
+        // forces the next evaluation, e.g. after the training data changed
+        void invalidate_fitness()
+        {
+            dirty = true;
+            fingerprinted = false;
+        }
+
+        // fitness known from elsewhere, e.g. a fitness_table
+        void set_fitness(ValueType const f)
+        {
+            fitness = f;
+            dirty = false;
+            rejected = false;
+        }
+
+        // Evaluates the trees over columns with f, e.g. from jit::compiler,
+        // until they change. owner keeps f valid and is shared by copies.
+        void set_native(native_function const f, std::shared_ptr<void const> owner)
+        {
+            native = f;
+            native_owner = std::move(owner);
+        }
+
+        bool has_native() const
+        {
+            return native != nullptr;
+        }
+
+        trees_type const& get_trees() const
+        {
+            return trees;
         }
 
         std::string expressions() const
@@ -70,31 +369,151 @@ namespace individual {
         template<class Result = std::array<ValueType, ValueSize>>
         Result value(std::array<ValueType, InputSize> const& variable_values) const
         {
+            auto const compiled = programs.get([this](programs_type &built){
+                auto const forms = this->flat_trees();
+                for(std::size_t i = 0; i < ValueSize; ++i){
+                    built[i] = bytecode::compile((*forms)[i]);
+                }
+            });
             Result values;
-            std::transform(trees.begin(), trees.end(), values.begin(),
-                    [&](tree_type t){
-                        return t.value(variable_values);
+            std::transform(compiled->begin(), compiled->end(), values.begin(),
+                    [&](bytecode::program<ValueType> const& p){
+                        return p(variable_values);
                     });
             return values;
         }
 
-        // TODO
-        ValueType calc_fitness()
+        // evaluates every tree over all rows of inputs at once
+        std::array<std::vector<ValueType>, ValueSize> values(batch::columns<ValueType> const& inputs) const
+        {
+            std::array<std::vector<ValueType>, ValueSize> retval;
+            auto const ptrs = inputs.pointers();
+            if(native){
+                std::array<ValueType*, ValueSize> outs;
+                for(std::size_t i = 0; i < ValueSize; ++i){
+                    retval[i].resize(inputs.rows());
+                    outs[i] = retval[i].data();
+                }
+                native(ptrs.data(), inputs.rows(), outs.data());
+                return retval;
+            }
+            batch::evaluator<ValueType> eval;
+            auto const forms = flat_trees();
+            for(std::size_t i = 0; i < ValueSize; ++i){
+                retval[i].resize(inputs.rows());
+                eval((*forms)[i], ptrs.data(), inputs.rows(), retval[i].data());
+            }
+            return retval;
+        }
+
+        // Mean squared error over every row and output, smaller is better.
+        // A non-finite error is replaced with the worst representable fitness.
+        // With a cache, subtrees already evaluated over the same inputs by
+        // any individual are reused instead of recomputed.
+        ValueType calc_fitness(batch::columns<ValueType> const& inputs,
+                               batch::columns<ValueType> const& outputs,
+                               batch::subtree_cache<ValueType>* const cache = nullptr)
+        {
+            calc_fitness_bounded(inputs, outputs, worst_fitness(), cache);
+            return fitness;
+        }
+
+        // Like calc_fitness(), but gives up once the fitness is sure to be
+        // above bound: the squared errors are summed config::fitness_block_rows
+        // rows at a time, and since they are never negative the sum so far
+        // divided by the full count is a lower bound of the final fitness.
+        // The individual is then rejected, its fitness being that lower
+        // bound. Returns the number of rows left out. With a cache the trees
+        // are evaluated over all rows at once, since cached results cover
+        // the whole data set, and nothing is left out. Native code, when
+        // set, takes the place of both.
+        std::size_t calc_fitness_bounded(batch::columns<ValueType> const& inputs,
+                                         batch::columns<ValueType> const& outputs,
+                                         ValueType const bound,
+                                         batch::subtree_cache<ValueType>* const cache = nullptr)
+        {
+            std::size_t const rows = inputs.rows();
+            ValueType const count = static_cast<ValueType>(rows * ValueSize);
+            bool const bounded = bound < worst_fitness() && (native || !cache);
+            std::size_t const block = bounded ? std::max<std::size_t>(config::fitness_block_rows, 1) : std::max<std::size_t>(rows, 1);
+
+            std::shared_ptr<flat_trees_type const> forms;
+            if(!native){
+                forms = flat_trees();
+            }
+            auto const ptrs = inputs.pointers();
+            std::vector<ValueType const*> block_ptrs(ptrs.size());
+            std::size_t const stride = std::min(block, rows);
+            std::vector<ValueType> predicted(stride * ValueSize);
+            std::array<ValueType*, ValueSize> outs;
+            for(std::size_t i = 0; i < ValueSize; ++i){
+                outs[i] = predicted.data() + i * stride;
+            }
+            batch::evaluator<ValueType> eval;
+            batch::cached_evaluator<ValueType>* const cached = cache ? &batch::thread_evaluator(*cache) : nullptr;
+            ValueType error = ValueType();
+            std::size_t done = 0;
+            while(done < rows){
+                std::size_t const n = std::min(block, rows - done);
+                for(std::size_t c = 0; c < ptrs.size(); ++c){
+                    block_ptrs[c] = ptrs[c] + done;
+                }
+                if(native){
+                    native(block_ptrs.data(), n, outs.data());
+                }else{
+                    for(std::size_t i = 0; i < ValueSize; ++i){
+                        if(cached){
+                            (*cached)((*forms)[i], block_ptrs.data(), n, outs[i]);
+                        }else{
+                            eval((*forms)[i], block_ptrs.data(), n, outs[i]);
+                        }
+                    }
+                }
+                for(std::size_t i = 0; i < ValueSize; ++i){
+                    ValueType const* expected = outputs.column(i) + done;
+                    for(std::size_t r = 0; r < n; ++r){
+                        ValueType const diff = outs[i][r] - expected[r];
+                        error += diff * diff;
+                    }
+                }
+                done += n;
+                if(!std::isfinite(error)){
+                    // stays non-finite whatever the remaining rows
+                    set_fitness(worst_fitness());
+                    return rows - done;
+                }
+                if(done < rows && error / count > bound){
+                    set_fitness(error / count);
+                    rejected = true;
+                    return rows - done;
+                }
+            }
+            if(rows != 0){
+                error /= count;
+            }
+            set_fitness(std::isfinite(error) ? error : worst_fitness());
+            return 0;
+        }
+
+        static ValueType worst_fitness()
         {
-            return 0.0;
+            return std::numeric_limits<ValueType>::has_infinity
+                 ? std::numeric_limits<ValueType>::infinity()
+                 : std::numeric_limits<ValueType>::max();
         }
     };
 
     template< class ValueType,
               std::size_t InputSize,
               std::size_t ValueSize,
-              class RandomTermGenerator = random_term::default_random_term<ValueType> >
-    inline individual<ValueType, InputSize, ValueSize, RandomTermGenerator> generate_random()
+              class RandomTermGenerator = random_term::default_random_term<ValueType>,
+              class Primitives = tree::operators::default_primitives >
+    inline individual<ValueType, InputSize, ValueSize, RandomTermGenerator, Primitives> generate_random()
     {
-        std::array<tree::tree<ValueType, RandomTermGenerator>, ValueSize> trees;
+        std::array<tree::tree<ValueType, RandomTermGenerator, Primitives>, ValueSize> trees;
         for(auto &t : trees){
 
-            t = tree::generate_random<ValueType, InputSize, RandomTermGenerator>(config::random_tree_depth);
+            t = tree::generate_random<ValueType, InputSize, RandomTermGenerator, Primitives>(config::random_tree_depth);
         }
         return {trees};
     }
@@ -102,26 +521,31 @@ namespace individual {
     template< class ValueType,
               std::size_t InputSize,
               std::size_t ValueSize,
-              class RandomTermGenerator >
-    void mutation(individual<ValueType, InputSize, ValueSize, RandomTermGenerator> &ind)
+              class RandomTermGenerator,
+              class Primitives >
+    void mutation(individual<ValueType, InputSize, ValueSize, RandomTermGenerator, Primitives> &ind)
     {
         for( auto &t : ind.trees ){
             tree::mutation<InputSize>(t);
         }
+        ind.invalidate();
     }
 
     template< class ValueType,
               std::size_t InputSize,
               std::size_t ValueSize,
-              class RandomTermGenerator >
-    void crossover(individual<ValueType, InputSize, ValueSize, RandomTermGenerator> &lhs,
-                   individual<ValueType, InputSize, ValueSize, RandomTermGenerator> &rhs)
+              class RandomTermGenerator,
+              class Primitives >
+    void crossover(individual<ValueType, InputSize, ValueSize, RandomTermGenerator, Primitives> &lhs,
+                   individual<ValueType, InputSize, ValueSize, RandomTermGenerator, Primitives> &rhs)
     {
         for(auto li = lhs.trees.begin(), ri = rhs.trees.begin();
-            li == lhs.trees.end() || ri == rhs.trees.end();
+            li != lhs.trees.end() && ri != rhs.trees.end();
             ++li, ++ri){
             tree::crossover(*li, *ri);
         }
+        lhs.invalidate();
+        rhs.invalidate();
     }
 
 } // namespace individual
@@ -0,0 +1,262 @@
+#if !defined GENE_INTERVAL_HPP_INCLUDED
+#define      GENE_INTERVAL_HPP_INCLUDED
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace gene {
+
+namespace intervals {
+
+    // Closed range [lo, hi] of the finite values an expression takes over
+    // a box of inputs. maybe_undefined is set when some inputs of the box
+    // may give inf or NaN instead (a division by a range holding 0, a
+    // square root of a range reaching below 0, an overflow, ...), and
+    // always along with an infinite end; undefined is set when all of them
+    // do, and the bounds are then meaningless.
+    template<class T>
+    struct interval{
+        T lo;
+        T hi;
+        bool maybe_undefined;
+        bool undefined;
+
+        static interval point(T const v)
+        {
+            return std::isfinite(v) ? interval{v, v, false, false} : failed();
+        }
+
+        static interval of(T const lo, T const hi)
+        {
+            return {lo, hi, false, false};
+        }
+
+        // any value, inf and NaN included
+        static interval whole()
+        {
+            T const inf = std::numeric_limits<T>::infinity();
+            return {-inf, inf, true, false};
+        }
+
+        // every input gives inf or NaN
+        static interval failed()
+        {
+            T const inf = std::numeric_limits<T>::infinity();
+            return {-inf, inf, true, true};
+        }
+
+        bool is_point() const
+        {
+            return !maybe_undefined && !undefined && lo == hi;
+        }
+
+        bool bounded() const
+        {
+            return std::isfinite(lo) && std::isfinite(hi);
+        }
+
+        bool contains(T const v) const
+        {
+            return lo <= v && v <= hi;
+        }
+    };
+
+    namespace impl {
+
+        // r with the flags of the operands; an infinite or NaN end means
+        // some inputs may overflow, both ends overflowing that all do
+        template<class T>
+        interval<T> finish(interval<T> r, bool const maybe, bool const undefined)
+        {
+            T const inf = std::numeric_limits<T>::infinity();
+            if(undefined || r.lo == inf || r.hi == -inf){
+                return interval<T>::failed();
+            }
+            if(std::isnan(r.lo) || std::isnan(r.hi)){
+                r = interval<T>::whole();
+            }
+            r.maybe_undefined = r.maybe_undefined || maybe || !r.bounded();
+            return r;
+        }
+
+        // product of two bounds, taking 0 * inf as 0 since the infinite
+        // end is never reached by a finite value
+        template<class T>
+        T product(T const a, T const b)
+        {
+            return a == T(0) || b == T(0) ? T(0) : a * b;
+        }
+
+        // values of either a or b
+        template<class T>
+        interval<T> hull(interval<T> const& a, interval<T> const& b)
+        {
+            if(a.undefined || b.undefined){
+                interval<T> r = a.undefined ? b : a;
+                r.maybe_undefined = true;
+                return r;
+            }
+            return {std::min(a.lo, b.lo), std::max(a.hi, b.hi), a.maybe_undefined || b.maybe_undefined, false};
+        }
+
+    } // namespace impl
+
+    template<class T>
+    interval<T> operator+(interval<T> const& a, interval<T> const& b)
+    {
+        return impl::finish(interval<T>::of(a.lo + b.lo, a.hi + b.hi),
+                            a.maybe_undefined || b.maybe_undefined, a.undefined || b.undefined);
+    }
+
+    template<class T>
+    interval<T> operator-(interval<T> const& a, interval<T> const& b)
+    {
+        return impl::finish(interval<T>::of(a.lo - b.hi, a.hi - b.lo),
+                            a.maybe_undefined || b.maybe_undefined, a.undefined || b.undefined);
+    }
+
+    template<class T>
+    interval<T> operator*(interval<T> const& a, interval<T> const& b)
+    {
+        T const p[] = { impl::product(a.lo, b.lo), impl::product(a.lo, b.hi),
+                        impl::product(a.hi, b.lo), impl::product(a.hi, b.hi) };
+        return impl::finish(interval<T>::of(*std::min_element(p, p + 4), *std::max_element(p, p + 4)),
+                            a.maybe_undefined || b.maybe_undefined, a.undefined || b.undefined);
+    }
+
+    template<class T>
+    interval<T> operator/(interval<T> const& a, interval<T> const& b)
+    {
+        bool const b_zero = b.lo == T(0) && b.hi == T(0);
+        if(a.undefined || (b_zero && !b.maybe_undefined)){
+            return interval<T>::failed();
+        }
+        // a finite value over an infinite one is 0
+        interval<T> const zero{T(0), T(0), true, false};
+        if(b.undefined || b_zero){
+            return zero;
+        }
+        interval<T> r = interval<T>::whole();
+        if(!b.contains(T(0))){
+            r = a * interval<T>::of(T(1) / b.hi, T(1) / b.lo);
+        }
+        r = impl::finish(r, a.maybe_undefined || b.maybe_undefined, false);
+        return b.maybe_undefined ? impl::hull(r, zero) : r;
+    }
+
+    // a / b, or 1 where b is 0
+    template<class T>
+    interval<T> protected_divide(interval<T> const& a, interval<T> const& b)
+    {
+        interval<T> const one = interval<T>::point(T(1));
+        if(b.lo == T(0) && b.hi == T(0) && !b.maybe_undefined){
+            return one;
+        }
+        if(!b.contains(T(0))){
+            return a / b;
+        }
+        interval<T> const r = b.lo == T(0) && b.hi == T(0) ? a / interval<T>::failed() : a / b;
+        return impl::hull(r, one);
+    }
+
+    template<class T>
+    interval<T> abs(interval<T> const& a)
+    {
+        interval<T> r = a;
+        if(a.lo >= T(0)){
+            r = interval<T>::of(a.lo, a.hi);
+        }else if(a.hi <= T(0)){
+            r = interval<T>::of(-a.hi, -a.lo);
+        }else{
+            r = interval<T>::of(T(0), std::max(-a.lo, a.hi));
+        }
+        return impl::finish(r, a.maybe_undefined, a.undefined);
+    }
+
+    template<class T>
+    interval<T> sqrt(interval<T> const& a)
+    {
+        if(a.hi < T(0)){
+            return interval<T>::failed();
+        }
+        auto const r = interval<T>::of(std::sqrt(std::max(a.lo, T(0))), std::sqrt(a.hi));
+        return impl::finish(r, a.maybe_undefined || a.lo < T(0), a.undefined);
+    }
+
+    template<class T>
+    interval<T> exp(interval<T> const& a)
+    {
+        // exp(-inf) is 0
+        interval<T> const zero{T(0), T(0), true, false};
+        if(a.undefined){
+            return zero;
+        }
+        auto const r = impl::finish(interval<T>::of(std::exp(a.lo), std::exp(a.hi)), a.maybe_undefined, false);
+        return a.maybe_undefined ? impl::hull(r, zero) : r;
+    }
+
+    template<class T>
+    interval<T> log(interval<T> const& a)
+    {
+        if(a.hi <= T(0)){
+            return interval<T>::failed();
+        }
+        T const lo = a.lo > T(0) ? std::log(a.lo) : -std::numeric_limits<T>::infinity();
+        return impl::finish(interval<T>::of(lo, std::log(a.hi)), a.maybe_undefined || a.lo <= T(0), a.undefined);
+    }
+
+    namespace impl {
+
+        // range of f, one of sin and cos, over a: that of its values at the
+        // ends, widened to 1 or -1 where a holds a maximum or minimum of f
+        // (at shift + pi/2 + 2k pi or shift - pi/2 + 2k pi)
+        template<class T, class F>
+        interval<T> sinusoid(interval<T> const& a, F f, T const shift)
+        {
+            T const pi = T(3.14159265358979323846264338327950288L);
+            if(!a.bounded()){
+                return finish(interval<T>::of(T(-1), T(1)), a.maybe_undefined, a.undefined);
+            }
+            T const f_lo = f(a.lo), f_hi = f(a.hi);
+            T r_lo = std::min(f_lo, f_hi), r_hi = std::max(f_lo, f_hi);
+            T const lo = a.lo - shift, hi = a.hi - shift;
+            if(std::ceil((lo - pi / 2) / (2 * pi)) <= std::floor((hi - pi / 2) / (2 * pi))){
+                r_hi = T(1);
+            }
+            if(std::ceil((lo + pi / 2) / (2 * pi)) <= std::floor((hi + pi / 2) / (2 * pi))){
+                r_lo = T(-1);
+            }
+            return finish(interval<T>::of(r_lo, r_hi), a.maybe_undefined, a.undefined);
+        }
+
+    } // namespace impl
+
+    template<class T>
+    interval<T> sin(interval<T> const& a)
+    {
+        return impl::sinusoid(a, [](T const v){ return std::sin(v); }, T(0));
+    }
+
+    template<class T>
+    interval<T> cos(interval<T> const& a)
+    {
+        return impl::sinusoid(a, [](T const v){ return std::cos(v); }, -T(3.14159265358979323846264338327950288L) / 2);
+    }
+
+    // b where a > 0, c elsewhere
+    template<class T>
+    interval<T> if_positive(interval<T> const& a, interval<T> const& b, interval<T> const& c)
+    {
+        // an undefined condition may be inf as well as NaN, and pick either
+        if(a.undefined || a.maybe_undefined || (a.lo <= T(0) && a.hi > T(0))){
+            return impl::hull(b, c);
+        }
+        return a.lo > T(0) ? b : c;
+    }
+
+} // namespace intervals
+
+} // namespace gene
+
+#endif    // GENE_INTERVAL_HPP_INCLUDED
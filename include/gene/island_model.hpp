@@ -0,0 +1,454 @@
+#if !defined GENE_ISLAND_MODEL_HPP_INCLUDED
+#define      GENE_ISLAND_MODEL_HPP_INCLUDED
+
+#include "config.hpp"
+#include "random.hpp"
+#include "spsc_queue.hpp"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <fstream>
+
+#if defined __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace gene {
+
+    enum struct topology{
+        ring,   // island i sends to i+1
+        torus,  // islands on a wrapping 2D grid send to their 4 neighbours
+        random  // each migration goes to one island chosen at random
+    };
+
+    namespace impl {
+
+        // Parses a sysfs CPU list such as "0-3,8-11".
+        inline std::vector<std::size_t> parse_cpu_list(std::string const& list)
+        {
+            std::vector<std::size_t> retval;
+            std::istringstream in(list);
+            std::string range;
+            while(std::getline(in, range, ',')){
+                std::size_t first = 0, last = 0;
+                char dash = 0;
+                std::istringstream r(range);
+                if(!(r >> first)){
+                    continue;
+                }
+                last = first;
+                if(r >> dash && dash == '-'){
+                    r >> last;
+                }
+                for(std::size_t cpu = first; cpu <= last; ++cpu){
+                    retval.push_back(cpu);
+                }
+            }
+            return retval;
+        }
+
+        // NUMA node of each CPU as listed under /sys/devices/system/node,
+        // empty if that is not available
+        inline std::vector<std::size_t> numa_nodes_of_cpus()
+        {
+            std::vector<std::size_t> retval;
+            for(std::size_t node = 0; ; ++node){
+                std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string list;
+                if(!in || !std::getline(in, list)){
+                    break;
+                }
+                for(auto const cpu : parse_cpu_list(list)){
+                    if(cpu >= retval.size()){
+                        retval.resize(cpu + 1, std::size_t(-1));
+                    }
+                    retval[cpu] = node;
+                }
+            }
+            return retval;
+        }
+
+        // CPUs this process may run on, those of one NUMA node next to each
+        // other, so that neighbouring islands tend to share a node.
+        inline std::vector<std::size_t> allowed_cpus()
+        {
+            std::vector<std::size_t> retval;
+#if defined __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if(sched_getaffinity(0, sizeof(set), &set) == 0){
+                for(std::size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu){
+                    if(CPU_ISSET(cpu, &set)){
+                        retval.push_back(cpu);
+                    }
+                }
+            }
+            auto const nodes = numa_nodes_of_cpus();
+            auto const node_of = [&](std::size_t const cpu){
+                return cpu < nodes.size() ? nodes[cpu] : std::size_t(-1);
+            };
+            std::stable_sort(retval.begin(), retval.end(),
+                    [&](std::size_t const lhs, std::size_t const rhs){
+                        return node_of(lhs) < node_of(rhs);
+                    });
+#endif
+            return retval;
+        }
+
+        inline void pin_to_cpu(std::size_t const cpu)
+        {
+#if defined __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+            (void)cpu;
+#endif
+        }
+
+        // reusable barrier that can be released early when a party fails
+        class barrier{
+        private:
+            std::mutex mutex;
+            std::condition_variable released;
+            std::size_t parties;
+            std::size_t waiting;
+            std::size_t phase;
+            bool aborted;
+
+        public:
+            explicit barrier(std::size_t const parties_)
+                : mutex(), released(), parties(parties_), waiting(0), phase(0), aborted(false)
+            {}
+
+            void wait()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                std::size_t const current = phase;
+                if(++waiting == parties){
+                    waiting = 0;
+                    ++phase;
+                    released.notify_all();
+                    return;
+                }
+                released.wait(lock, [&]{ return phase != current || aborted; });
+            }
+
+            void abort()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                aborted = true;
+                released.notify_all();
+            }
+        };
+
+    } // namespace impl
+
+    // Runs several populations side by side, one thread each, and every
+    // migration_interval generations sends copies of the migrant_count best
+    // individuals of each island to its neighbours, where they replace the
+    // worst. Migrants travel through one single-producer single-consumer
+    // queue per directed link, so islands never wait for each other, except
+    // at the barrier after each migration when config::migration_barrier is
+    // set. Migrants that find a full queue are dropped.
+    //
+    // Each island draws from its own random::stream, so with the barrier
+    // on a run is reproducible whatever the scheduling.
+    template<class Population>
+    class island_model{
+    public:
+        typedef Population population_type;
+        typedef typename Population::individual_type individual_type;
+
+        struct statistics{
+            std::size_t sent;
+            std::size_t received;
+            std::size_t dropped;
+        };
+
+    private:
+        // keeps the island streams apart from the per-thread default ones
+        static constexpr std::uint64_t stream_base = std::uint64_t(1) << 32;
+
+        struct link{
+            std::size_t to;
+            spsc_queue<individual_type> queue;
+
+            link(std::size_t const to_, std::size_t const capacity) : to(to_), queue(capacity) {}
+        };
+
+        struct island{
+            std::unique_ptr<Population> population;
+            random::engine_type engine;
+            std::vector<link*> outgoing;
+            std::vector<link*> incoming;
+            statistics stats;
+        };
+
+        std::vector<island> islands;
+        std::vector<std::unique_ptr<link>> links;
+        std::vector<std::size_t> cpus;
+        topology shape;
+        std::size_t interval;
+        std::size_t migrants;
+
+        void connect(std::size_t const from, std::size_t const to)
+        {
+            if(from == to){
+                return;
+            }
+            for(auto l : islands[from].outgoing){
+                if(l->to == to){
+                    return;
+                }
+            }
+            // room for a few migrations in flight
+            links.emplace_back(new link(to, std::max<std::size_t>(4 * migrants, 1)));
+            islands[from].outgoing.push_back(links.back().get());
+            islands[to].incoming.push_back(links.back().get());
+        }
+
+        void build_topology()
+        {
+            std::size_t const n = islands.size();
+            switch(shape){
+            case topology::ring:
+                for(std::size_t i = 0; i < n; ++i){
+                    connect(i, (i + 1) % n);
+                }
+                break;
+            case topology::torus:
+                {
+                    std::size_t rows = static_cast<std::size_t>(std::sqrt(static_cast<double>(n)));
+                    while(rows > 1 && n % rows != 0){
+                        --rows;
+                    }
+                    rows = std::max<std::size_t>(rows, 1);
+                    std::size_t const cols = n / rows;
+                    for(std::size_t r = 0; r < rows; ++r){
+                        for(std::size_t c = 0; c < cols; ++c){
+                            std::size_t const i = r * cols + c;
+                            connect(i, r * cols + (c + 1) % cols);
+                            connect(i, r * cols + (c + cols - 1) % cols);
+                            connect(i, (r + 1) % rows * cols + c);
+                            connect(i, (r + rows - 1) % rows * cols + c);
+                        }
+                    }
+                }
+                break;
+            case topology::random:
+                for(std::size_t i = 0; i < n; ++i){
+                    for(std::size_t j = 0; j < n; ++j){
+                        connect(i, j);
+                    }
+                }
+                break;
+            }
+        }
+
+        void emigrate(island &isl)
+        {
+            if(isl.outgoing.empty()){
+                return;
+            }
+            auto const best = isl.population->best_individuals(migrants);
+            auto send = [&](link &l){
+                for(auto const& ind : best){
+                    if(l.queue.try_push(ind)){
+                        ++isl.stats.sent;
+                    }else{
+                        ++isl.stats.dropped;
+                    }
+                }
+            };
+            if(shape == topology::random){
+                send(*isl.outgoing[random::uniform_index(isl.outgoing.size())]);
+            }else{
+                for(auto l : isl.outgoing){
+                    send(*l);
+                }
+            }
+        }
+
+        void immigrate(island &isl)
+        {
+            std::vector<individual_type> arrived;
+            for(auto l : isl.incoming){
+                l->queue.pop_all(arrived);
+            }
+            isl.stats.received += arrived.size();
+            isl.population->replace_worst(arrived);
+        }
+
+        // Calls f(i) for every island i on a thread of its own, pinned to
+        // the CPU of the island and using its random stream, so that the
+        // memory the island touches first is local to that CPU. The first
+        // exception thrown is rethrown here.
+        template<class F>
+        void for_each_island(F f)
+        {
+            std::vector<std::exception_ptr> errors(islands.size());
+            std::vector<std::thread> threads;
+            for(std::size_t i = 0; i < islands.size(); ++i){
+                threads.emplace_back([&, i]{
+                    try{
+                        if(!cpus.empty()){
+                            impl::pin_to_cpu(cpus[i % cpus.size()]);
+                        }
+                        random::scoped_engine use(islands[i].engine);
+                        f(i);
+                    }catch(...){
+                        errors[i] = std::current_exception();
+                    }
+                });
+            }
+            for(auto &t : threads){
+                t.join();
+            }
+            for(auto const& e : errors){
+                if(e){
+                    std::rethrow_exception(e);
+                }
+            }
+        }
+
+    public:
+        // Each island's population is built on its own pinned thread. The
+        // CPUs are chosen here, with config::pin_threads as it is now.
+        // island_count == 0 makes one island per hardware thread
+        explicit island_model(std::size_t island_count = config::thread_count,
+                              topology const shape_ = topology::ring,
+                              std::size_t const interval_ = config::migration_interval,
+                              std::size_t const migrants_ = config::migrant_count)
+            : islands(), links(), cpus(config::pin_threads ? impl::allowed_cpus() : std::vector<std::size_t>()),
+              shape(shape_), interval(interval_), migrants(migrants_)
+        {
+            if(island_count == 0){
+                island_count = std::max(1u, std::thread::hardware_concurrency());
+            }
+            islands.resize(island_count);
+            for(std::size_t i = 0; i < island_count; ++i){
+                islands[i].engine = random::stream(stream_base + i);
+                islands[i].stats = statistics{0, 0, 0};
+            }
+            for_each_island([this](std::size_t const i){
+                islands[i].population.reset(new Population);
+                islands[i].population->set_serial_evaluation(true);
+            });
+            build_topology();
+        }
+
+        island_model(island_model const&) = delete;
+        island_model& operator=(island_model const&) = delete;
+
+        // Each island copies and scores the data on its own pinned thread.
+        template<class Tuple>
+        void set_training_data(std::vector<Tuple> const& data)
+        {
+            for_each_island([&](std::size_t const i){
+                islands[i].population->set_training_data(data);
+            });
+        }
+
+        // Runs every island for the given number of generations on threads
+        // of its own, pinned to distinct CPUs with config::pin_threads.
+        // The first exception thrown on an island is rethrown here.
+        void run(std::size_t const generations)
+        {
+            impl::barrier sync(islands.size());
+            for_each_island([&](std::size_t const i){
+                try{
+                    auto &isl = islands[i];
+                    for(std::size_t g = 0; g < generations; ++g){
+                        isl.population->next_generation();
+                        bool const migration = interval != 0 && isl.population->current_generation() % interval == 0;
+                        if(!config::migration_barrier){
+                            immigrate(isl);
+                            if(migration){
+                                emigrate(isl);
+                            }
+                        }else if(migration){
+                            // everyone sends, then everyone receives
+                            emigrate(isl);
+                            sync.wait();
+                            immigrate(isl);
+                            sync.wait();
+                        }
+                    }
+                }catch(...){
+                    sync.abort();
+                    throw;
+                }
+            });
+        }
+
+        std::size_t size() const
+        {
+            return islands.size();
+        }
+
+        Population& operator[](std::size_t const i)
+        {
+            return *islands[i].population;
+        }
+
+        Population const& operator[](std::size_t const i) const
+        {
+            return *islands[i].population;
+        }
+
+        // islands island i sends migrants to
+        std::vector<std::size_t> neighbours(std::size_t const i) const
+        {
+            std::vector<std::size_t> retval;
+            for(auto l : islands[i].outgoing){
+                retval.push_back(l->to);
+            }
+            return retval;
+        }
+
+        // best individual over all islands; not while run() is going on
+        individual_type const& most_suitable_individual()
+        {
+            individual_type const* best = nullptr;
+            for(auto &isl : islands){
+                auto const& candidate = isl.population->most_suitable_individual();
+                if(!best || candidate.fitness < best->fitness){
+                    best = &candidate;
+                }
+            }
+            return *best;
+        }
+
+        typename individual_type::value_type fitness()
+        {
+            return most_suitable_individual().fitness;
+        }
+
+        statistics stats() const
+        {
+            statistics retval{0, 0, 0};
+            for(auto const& isl : islands){
+                retval.sent += isl.stats.sent;
+                retval.received += isl.stats.received;
+                retval.dropped += isl.stats.dropped;
+            }
+            return retval;
+        }
+    };
+
+} // namespace gene
+
+#endif    // GENE_ISLAND_MODEL_HPP_INCLUDED
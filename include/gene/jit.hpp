@@ -0,0 +1,387 @@
+#if !defined GENE_JIT_HPP_INCLUDED
+#define      GENE_JIT_HPP_INCLUDED
+
+#include "config.hpp"
+#include "individual.hpp"
+#include "population.hpp"
+#include "codegen.hpp"
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+
+#if defined __unix__ || defined __APPLE__
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define GENE_HAS_DLOPEN
+#endif
+
+// Native code for individuals, built by the system compiler. The trees of
+// an individual are written out by codegen, compiled into a shared object
+// on a background thread and loaded with dlopen; the individual then
+// evaluates through the loaded function (see individual::set_native).
+// Link with -ldl where dlopen is not part of libc. Without dlopen nothing
+// is ever attached and individuals keep their usual evaluation.
+
+namespace gene {
+
+namespace jit {
+
+    // a loaded shared object, unloaded when the last user lets go of it
+    class library{
+    private:
+        void* handle;
+
+    public:
+        explicit library(std::string const& path) : handle(nullptr)
+        {
+#if defined GENE_HAS_DLOPEN
+            handle = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#else
+            (void)path;
+#endif
+        }
+
+        library(library const&) = delete;
+        library& operator=(library const&) = delete;
+
+        ~library()
+        {
+#if defined GENE_HAS_DLOPEN
+            if(handle){
+                ::dlclose(handle);
+            }
+#endif
+        }
+
+        bool loaded() const
+        {
+            return handle != nullptr;
+        }
+
+        // null if missing
+        void* symbol(char const* const name) const
+        {
+#if defined GENE_HAS_DLOPEN
+            return handle ? ::dlsym(handle, name) : nullptr;
+#else
+            (void)name;
+            return nullptr;
+#endif
+        }
+    };
+
+    // name of the function every generated object exports
+    constexpr char const entry_name[] = "gene_jit_predict";
+
+    // Source compiled for ind: its codegen header and an extern "C"
+    // entry point with the signature of individual::native_function.
+    template<class ValueType, std::size_t InputSize, std::size_t ValueSize, class RandomTermGen, class Primitives>
+    std::string source(individual::individual<ValueType, InputSize, ValueSize, RandomTermGen, Primitives> const& ind)
+    {
+        std::string const t = codegen::type_traits<ValueType>::name();
+        std::ostringstream out;
+        codegen::write_header(out, ind, "gene_jit_model");
+        out << "\nextern \"C\" void " << entry_name << "(" << t << " const* const* columns, std::size_t rows, "
+            << t << "* const* outputs)\n"
+            << "{\n"
+            << "    gene_jit_model::predict(columns, rows, outputs);\n"
+            << "}\n";
+        return out.str();
+    }
+
+    // Compiles individuals in the background and caches the results on
+    // disk in directory, named by a hash of their source. Objects on disk
+    // are reused, after checking the source kept next to them, so later
+    // runs skip the compiler. The disk cache may be shared by processes:
+    // files are written under temporary names and renamed into place.
+    //
+    // In memory, a loaded object stays loaded only while individuals use
+    // it; one needed again after that is loaded from disk. At most
+    // max_builds compilations run at once, and attach() starts none while
+    // that many are under way.
+    //
+    // command is run by the shell with the output and source paths
+    // appended, as "command -o object source"; it must accept C++11.
+    class compiler{
+    public:
+        struct statistics{
+            std::size_t compiled;   // by the system compiler
+            std::size_t reused;     // loaded from the disk cache
+            std::size_t failed;     // compiler or loader errors
+            std::size_t attached;   // individuals given native code
+        };
+
+    private:
+        typedef std::shared_future<std::shared_ptr<library const>> result_type;
+
+        struct entry{
+            std::size_t check;                      // second hash of the source, against digest collisions
+            result_type pending;                    // until taken by attach() or sweep()
+            std::weak_ptr<library const> loaded;
+            bool failed;
+        };
+
+        std::string directory;
+        std::string command;
+        std::size_t max_builds;
+        std::mutex mutex;
+        std::unordered_map<std::string, entry> results;     // by digest of the source
+        std::size_t sweep_size;
+        std::atomic<std::size_t> building;
+        std::atomic<std::size_t> compiled_count;
+        std::atomic<std::size_t> reused_count;
+        std::atomic<std::size_t> failed_count;
+        std::atomic<std::size_t> attached_count;
+        std::atomic<std::size_t> temporary_count;
+
+        // FNV-1a, stable across runs and platforms unlike std::hash
+        static std::string digest(std::string const& s)
+        {
+            std::uint64_t h = 14695981039346656037ULL;
+            for(unsigned char const c : s){
+                h = (h ^ c) * 1099511628211ULL;
+            }
+            char buf[17];
+            std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+            return buf;
+        }
+
+        static bool read_file(std::string const& path, std::string &contents)
+        {
+            std::ifstream in(path, std::ios::binary);
+            if(!in){
+                return false;
+            }
+            contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            return true;
+        }
+
+        static bool write_file(std::string const& path, std::string const& contents)
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << contents;
+            return static_cast<bool>(out);
+        }
+
+        static std::shared_ptr<library const> load(std::string const& path)
+        {
+            auto lib = std::make_shared<library const>(path);
+            return lib->loaded() && lib->symbol(entry_name) ? lib : nullptr;
+        }
+
+        // Takes a finished build into e, so that its library is held only
+        // by the individuals using it, and returns the library; null if
+        // the build is not over or failed.
+        static std::shared_ptr<library const> settle(entry &e)
+        {
+            std::shared_ptr<library const> lib;
+            if(e.pending.valid() && e.pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready){
+                lib = e.pending.get();
+                e.loaded = lib;
+                e.failed = !lib;
+                e.pending = result_type();
+            }
+            return lib;
+        }
+
+        // forgets the libraries nobody uses any more
+        void sweep_locked()
+        {
+            for(auto i = results.begin(); i != results.end();){
+                settle(i->second);
+                if(!i->second.pending.valid() && !i->second.failed && i->second.loaded.expired()){
+                    i = results.erase(i);
+                }else{
+                    ++i;
+                }
+            }
+            sweep_size = 2 * results.size() + 64;
+        }
+
+        std::string temporary(std::string const& path)
+        {
+#if defined GENE_HAS_DLOPEN
+            long const pid = static_cast<long>(::getpid());
+#else
+            long const pid = 0;
+#endif
+            return path + ".tmp" + std::to_string(pid) + "_" + std::to_string(temporary_count++);
+        }
+
+        // runs on a background thread
+        std::shared_ptr<library const> build(std::string const& src)
+        {
+#if defined GENE_HAS_DLOPEN
+            std::string const base = directory + "/gene_jit_" + digest(src);
+            std::string const source_path = base + ".cpp";
+            std::string const object_path = base + ".so";
+
+            std::string cached;
+            if(read_file(source_path, cached) && cached == src){
+                if(auto lib = load(object_path)){
+                    ++reused_count;
+                    return lib;
+                }
+            }
+
+            std::string const source_tmp = temporary(source_path) + ".cpp";
+            std::string const object_tmp = temporary(object_path);
+            bool ok = write_file(source_tmp, src)
+                && std::system((command + " -o '" + object_tmp + "' '" + source_tmp + "'").c_str()) == 0
+                && std::rename(object_tmp.c_str(), object_path.c_str()) == 0;
+            // the source goes last, so it is only found next to a finished object
+            ok = ok && std::rename(source_tmp.c_str(), source_path.c_str()) == 0;
+            std::remove(source_tmp.c_str());
+            std::remove(object_tmp.c_str());
+            auto lib = ok ? load(object_path) : nullptr;
+            if(lib){
+                ++compiled_count;
+            }else{
+                ++failed_count;
+            }
+            return lib;
+#else
+            (void)src;
+            ++failed_count;
+            return nullptr;
+#endif
+        }
+
+    public:
+        static std::string default_command()
+        {
+            return "c++ -std=c++11 -O2 -ffp-contract=off -fPIC -shared -w";
+        }
+
+        explicit compiler(std::string directory_, std::string command_ = default_command(), std::size_t const max_builds_ = 2)
+            : directory(std::move(directory_)), command(std::move(command_)), max_builds(max_builds_ ? max_builds_ : 1),
+              mutex(), results(), sweep_size(64), building(0),
+              compiled_count(0), reused_count(0), failed_count(0), attached_count(0), temporary_count(0)
+        {
+#if defined GENE_HAS_DLOPEN
+            ::mkdir(directory.c_str(), 0777);
+#endif
+        }
+
+        compiler(compiler const&) = delete;
+        compiler& operator=(compiler const&) = delete;
+
+        ~compiler()
+        {
+            wait();
+        }
+
+        // Gives ind its native code if it is ready and returns true.
+        // Otherwise starts compiling it, unless that is under way, has
+        // failed or max_builds compilations are running, and returns false;
+        // ind evaluates as before meanwhile.
+        template<class Individual>
+        bool attach(Individual &ind)
+        {
+            if(ind.has_native()){
+                return true;
+            }
+            std::string const src = source(ind);
+            std::string const key = digest(src);
+            std::size_t const check = std::hash<std::string>()(src);
+            std::shared_ptr<library const> lib;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(results.size() >= sweep_size){
+                    sweep_locked();
+                }
+                auto found = results.find(key);
+                if(found != results.end() && found->second.check != check){
+                    // another source with the same digest; the disk cache
+                    // keeps the newest, so this one is rebuilt
+                    if(found->second.pending.valid()){
+                        return false;
+                    }
+                    results.erase(found);
+                    found = results.end();
+                }
+                if(found != results.end()){
+                    lib = settle(found->second);
+                    if(found->second.pending.valid() || found->second.failed){
+                        return false;
+                    }
+                    if(!lib){
+                        lib = found->second.loaded.lock();
+                    }
+                }
+                if(!lib){
+                    if(building >= max_builds){
+                        return false;
+                    }
+                    ++building;
+                    result_type const pending = std::async(std::launch::async, [this, src]{
+                        auto lib = this->build(src);
+                        --building;
+                        return lib;
+                    }).share();
+                    results[key] = entry{check, pending, std::weak_ptr<library const>(), false};
+                    return false;
+                }
+            }
+            ind.set_native(reinterpret_cast<typename Individual::native_function>(lib->symbol(entry_name)), lib);
+            ++attached_count;
+            return true;
+        }
+
+        // blocks until every compilation started so far is over
+        void wait()
+        {
+            std::vector<result_type> pending;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for(auto const& r : results){
+                    if(r.second.pending.valid()){
+                        pending.push_back(r.second.pending);
+                    }
+                }
+            }
+            for(auto const& r : pending){
+                r.wait();
+            }
+        }
+
+        statistics stats() const
+        {
+            return {compiled_count, reused_count, failed_count, attached_count};
+        }
+    };
+
+    // Compiles the top_k best individuals of p after each of its
+    // evaluations and attaches the code once it is ready. Elites carried
+    // over to the next generation keep it, so those that stay on top long
+    // enough run natively from then on.
+    template<class ValueType, std::size_t InputSize, std::size_t OutputSize, class RandomTermGen, class Primitives>
+    void attach(population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives> &p,
+                std::shared_ptr<compiler> const& c,
+                std::size_t const top_k)
+    {
+        typedef typename population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives>::individual_type individual_type;
+        p.set_elite_callback(top_k, [c](individual_type &ind){
+            c->attach(ind);
+        });
+    }
+
+} // namespace jit
+
+} // namespace gene
+
+#endif    // GENE_JIT_HPP_INCLUDED
@@ -0,0 +1,108 @@
+#if !defined GENE_MAPPED_FILE_HPP_INCLUDED
+#define      GENE_MAPPED_FILE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#if defined __unix__ || defined __APPLE__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define GENE_HAS_MMAP
+#endif
+
+namespace gene {
+
+    // File contents mapped read-only, or read into memory where mmap is
+    // missing. Pages are loaded on first access and can be handed back to
+    // the system with release(), so files larger than memory can be scanned.
+    class mapped_file{
+    private:
+        char const* data_;
+        std::size_t size_;
+        std::vector<char> buffer;
+
+    public:
+        explicit mapped_file(std::string const& path) : data_(nullptr), size_(0), buffer()
+        {
+#if defined GENE_HAS_MMAP
+            int const fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0){
+                throw("gene::mapped_file: cannot open file.");
+            }
+            struct stat st;
+            if(::fstat(fd, &st) != 0){
+                ::close(fd);
+                throw("gene::mapped_file: cannot stat file.");
+            }
+            size_ = static_cast<std::size_t>(st.st_size);
+            if(size_ != 0){
+                void* const p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if(p == MAP_FAILED){
+                    throw("gene::mapped_file: mmap failed.");
+                }
+                data_ = static_cast<char const*>(p);
+            }else{
+                ::close(fd);
+            }
+#else
+            std::ifstream in(path, std::ios::binary);
+            if(!in){
+                throw("gene::mapped_file: cannot open file.");
+            }
+            buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            data_ = buffer.data();
+            size_ = buffer.size();
+#endif
+        }
+
+        mapped_file(mapped_file const&) = delete;
+        mapped_file& operator=(mapped_file const&) = delete;
+
+        ~mapped_file()
+        {
+#if defined GENE_HAS_MMAP
+            if(data_){
+                ::munmap(const_cast<char*>(data_), size_);
+            }
+#endif
+        }
+
+        char const* data() const
+        {
+            return data_;
+        }
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+        // drops the pages wholly inside [offset, offset + length) from memory;
+        // they are read again from the file if touched later
+        void release(std::size_t const offset, std::size_t const length) const
+        {
+#if defined GENE_HAS_MMAP && defined MADV_DONTNEED
+            std::size_t const page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            std::size_t const first = (offset + page - 1) / page * page;
+            std::size_t const last = std::min(offset + length, size_) / page * page;
+            if(data_ && first < last){
+                ::madvise(const_cast<char*>(data_) + first, last - first, MADV_DONTNEED);
+            }
+#else
+            (void)offset;
+            (void)length;
+#endif
+        }
+    };
+
+} // namespace gene
+
+#endif    // GENE_MAPPED_FILE_HPP_INCLUDED
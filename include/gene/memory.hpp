@@ -0,0 +1,365 @@
+#if !defined GENE_MEMORY_HPP_INCLUDED
+#define      GENE_MEMORY_HPP_INCLUDED
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <new>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace gene {
+
+namespace memory {
+
+    struct statistics{
+        std::size_t allocations;
+        std::size_t deallocations;
+        std::size_t bytes_in_use;   // requested by live allocations
+        std::size_t bytes_reserved; // obtained from the system and still held
+
+        statistics() : allocations(0), deallocations(0), bytes_in_use(0), bytes_reserved(0) {}
+    };
+
+    inline statistics& operator+=(statistics &lhs, statistics const& rhs)
+    {
+        lhs.allocations += rhs.allocations;
+        lhs.deallocations += rhs.deallocations;
+        lhs.bytes_in_use += rhs.bytes_in_use;
+        lhs.bytes_reserved += rhs.bytes_reserved;
+        return lhs;
+    }
+
+    // Where tree nodes come from. allocate() is only called by the thread that
+    // selected the resource with scoped_resource (or owns it, for the
+    // per-thread pools), but deallocate() may come from any thread.
+    class resource{
+    private:
+        std::atomic<std::size_t> allocation_count;
+        std::atomic<std::size_t> deallocation_count;
+        std::atomic<std::size_t> in_use;
+
+    protected:
+        std::atomic<std::size_t> reserved;
+
+        virtual void* do_allocate(std::size_t bytes, std::size_t alignment) = 0;
+        virtual void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) = 0;
+
+    public:
+        resource() : allocation_count(0), deallocation_count(0), in_use(0), reserved(0) {}
+        resource(resource const&) = delete;
+        resource& operator=(resource const&) = delete;
+        virtual ~resource() {}
+
+        void* allocate(std::size_t const bytes, std::size_t const alignment)
+        {
+            void* const p = do_allocate(bytes, alignment);
+            allocation_count.fetch_add(1, std::memory_order_relaxed);
+            in_use.fetch_add(bytes, std::memory_order_relaxed);
+            return p;
+        }
+
+        void deallocate(void* const p, std::size_t const bytes, std::size_t const alignment)
+        {
+            do_deallocate(p, bytes, alignment);
+            deallocation_count.fetch_add(1, std::memory_order_relaxed);
+            in_use.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+
+        statistics stats() const
+        {
+            statistics s;
+            s.allocations = allocation_count.load(std::memory_order_relaxed);
+            s.deallocations = deallocation_count.load(std::memory_order_relaxed);
+            s.bytes_in_use = in_use.load(std::memory_order_relaxed);
+            s.bytes_reserved = reserved.load(std::memory_order_relaxed);
+            return s;
+        }
+    };
+
+    // plain operator new / delete
+    class new_delete_resource : public resource{
+    protected:
+        void* do_allocate(std::size_t const bytes, std::size_t) override
+        {
+            reserved.fetch_add(bytes, std::memory_order_relaxed);
+            return ::operator new(bytes);
+        }
+
+        void do_deallocate(void* const p, std::size_t const bytes, std::size_t) override
+        {
+            reserved.fetch_sub(bytes, std::memory_order_relaxed);
+            ::operator delete(p);
+        }
+    };
+
+    namespace impl {
+
+        constexpr std::size_t granularity = 16;
+        constexpr std::size_t class_count = 32;   // blocks of 16 to 512 bytes
+        constexpr std::size_t chunk_size = 64 * 1024;
+
+        inline std::size_t round_up(std::size_t const bytes)
+        {
+            return (bytes + granularity - 1) / granularity * granularity;
+        }
+
+    } // namespace impl
+
+    // Size-classed free lists carved from 64KiB chunks. Blocks are recycled
+    // within the resource and the chunks are only returned on destruction.
+    // Requests over 512 bytes or over 16-byte alignment go to operator new.
+    // Only the owning thread allocates; blocks freed by other threads are
+    // pushed onto lock-free lists that the owner takes over when it runs dry.
+    // A pool without an owner (see release()) takes every block that way
+    // until a thread adopt()s it, free lists and all.
+    class pool_resource : public resource{
+    private:
+        struct free_block{
+            free_block* next;
+        };
+
+        std::atomic<std::thread::id> owner;
+        free_block* free_lists[impl::class_count];
+        std::atomic<free_block*> remote_free_lists[impl::class_count];
+        std::vector<char*> chunks;
+        char* cursor;
+        char* chunk_end;
+
+    protected:
+        void* do_allocate(std::size_t const bytes, std::size_t const alignment) override
+        {
+            if(bytes > impl::granularity * impl::class_count || alignment > impl::granularity){
+                reserved.fetch_add(bytes, std::memory_order_relaxed);
+                return ::operator new(bytes);
+            }
+            std::size_t const size = impl::round_up(std::max<std::size_t>(bytes, 1));
+            std::size_t const size_class = size / impl::granularity - 1;
+            free_block* &head = free_lists[size_class];
+            if(!head){
+                head = remote_free_lists[size_class].exchange(nullptr, std::memory_order_acquire);
+            }
+            if(head){
+                free_block* const b = head;
+                head = b->next;
+                return b;
+            }
+            if(static_cast<std::size_t>(chunk_end - cursor) < size){
+                chunks.push_back(static_cast<char*>(::operator new(impl::chunk_size)));
+                reserved.fetch_add(impl::chunk_size, std::memory_order_relaxed);
+                cursor = chunks.back();
+                chunk_end = cursor + impl::chunk_size;
+            }
+            void* const p = cursor;
+            cursor += size;
+            return p;
+        }
+
+        void do_deallocate(void* const p, std::size_t const bytes, std::size_t const alignment) override
+        {
+            if(bytes > impl::granularity * impl::class_count || alignment > impl::granularity){
+                reserved.fetch_sub(bytes, std::memory_order_relaxed);
+                ::operator delete(p);
+                return;
+            }
+            std::size_t const size = impl::round_up(std::max<std::size_t>(bytes, 1));
+            std::size_t const size_class = size / impl::granularity - 1;
+            free_block* const b = static_cast<free_block*>(p);
+            if(std::this_thread::get_id() == owner.load(std::memory_order_relaxed)){
+                b->next = free_lists[size_class];
+                free_lists[size_class] = b;
+            }else{
+                auto &remote = remote_free_lists[size_class];
+                b->next = remote.load(std::memory_order_relaxed);
+                while(!remote.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)){
+                }
+            }
+        }
+
+    public:
+        pool_resource()
+            : owner(std::this_thread::get_id()), free_lists(), chunks(), cursor(nullptr), chunk_end(nullptr)
+        {
+            for(auto &l : remote_free_lists){
+                l.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~pool_resource()
+        {
+            for(auto c : chunks){
+                ::operator delete(c);
+            }
+        }
+
+        // Gives up ownership; the owner must not use the pool afterwards.
+        void release()
+        {
+            owner.store(std::thread::id(), std::memory_order_relaxed);
+        }
+
+        // Makes the calling thread the owner of a released pool. The hand
+        // over must be synchronized, e.g. by a mutex, with release().
+        void adopt()
+        {
+            owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        }
+    };
+
+    namespace impl {
+
+        struct pool_registry{
+            std::mutex mutex;
+            std::vector<pool_resource*> pools;
+            std::vector<pool_resource*> released;   // by threads that exited
+        };
+
+        // never destroyed, like the pools it lists
+        inline pool_registry& registry()
+        {
+            static pool_registry* const r = new pool_registry;
+            return *r;
+        }
+
+        // Ties a pool to a thread; the pool goes back to the registry when
+        // the thread exits.
+        class pool_lease{
+        private:
+            pool_resource* pool;
+
+        public:
+            pool_lease() : pool(nullptr)
+            {
+                std::lock_guard<std::mutex> lock(registry().mutex);
+                auto &released = registry().released;
+                if(released.empty()){
+                    pool = new pool_resource;
+                    registry().pools.push_back(pool);
+                }else{
+                    pool = released.back();
+                    released.pop_back();
+                    pool->adopt();
+                }
+            }
+
+            pool_lease(pool_lease const&) = delete;
+            pool_lease& operator=(pool_lease const&) = delete;
+
+            ~pool_lease()
+            {
+                std::lock_guard<std::mutex> lock(registry().mutex);
+                pool->release();
+                registry().released.push_back(pool);
+            }
+
+            pool_resource& get() const
+            {
+                return *pool;
+            }
+        };
+
+        // One pool per thread. Nodes may outlive the thread that created them,
+        // so the pools are deliberately never destroyed; that of a thread that
+        // exited is adopted by the next new thread, with its free blocks.
+        inline pool_resource& thread_pool()
+        {
+            static thread_local pool_lease lease;
+            return lease.get();
+        }
+
+        inline resource*& current_resource()
+        {
+            static thread_local resource* r = nullptr;
+            return r;
+        }
+
+    } // namespace impl
+
+    // The resource new nodes come from on this thread: the innermost
+    // scoped_resource, or the thread's own pool_resource.
+    inline resource& current()
+    {
+        auto const r = impl::current_resource();
+        return r ? *r : impl::thread_pool();
+    }
+
+    // Sum of the statistics of all per-thread pools.
+    inline statistics thread_pools_statistics()
+    {
+        statistics retval;
+        std::lock_guard<std::mutex> lock(impl::registry().mutex);
+        for(auto p : impl::registry().pools){
+            retval += p->stats();
+        }
+        return retval;
+    }
+
+    class scoped_resource{
+    private:
+        resource* previous;
+
+    public:
+        explicit scoped_resource(resource &r) : previous(impl::current_resource())
+        {
+            impl::current_resource() = &r;
+        }
+
+        scoped_resource(scoped_resource const&) = delete;
+        scoped_resource& operator=(scoped_resource const&) = delete;
+
+        ~scoped_resource()
+        {
+            impl::current_resource() = previous;
+        }
+    };
+
+    // Standard allocator bound to a resource, by default the current one.
+    // Copies (e.g. the one kept in a shared_ptr control block) keep pointing
+    // to the resource the memory came from.
+    template<class T>
+    class allocator{
+    private:
+        resource* res;
+
+        template<class U>
+        friend class allocator;
+
+    public:
+        typedef T value_type;
+
+        allocator() : res(&current()) {}
+        explicit allocator(resource &r) : res(&r) {}
+        template<class U>
+        allocator(allocator<U> const& other) : res(other.res) {}
+
+        T* allocate(std::size_t const n)
+        {
+            return static_cast<T*>(res->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* const p, std::size_t const n)
+        {
+            res->deallocate(p, n * sizeof(T), alignof(T));
+        }
+
+        template<class U>
+        bool operator==(allocator<U> const& other) const
+        {
+            return res == other.res;
+        }
+
+        template<class U>
+        bool operator!=(allocator<U> const& other) const
+        {
+            return res != other.res;
+        }
+    };
+
+} // namespace memory
+
+} // namespace gene
+
+#endif    // GENE_MEMORY_HPP_INCLUDED
@@ -0,0 +1,258 @@
+#if !defined GENE_METRICS_HPP_INCLUDED
+#define      GENE_METRICS_HPP_INCLUDED
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace gene {
+
+namespace metrics {
+
+    namespace impl {
+
+        constexpr std::size_t shard_count = 64;
+
+        inline std::size_t next_shard()
+        {
+            static std::atomic<std::size_t> count(0);
+            return count++ % shard_count;
+        }
+
+        inline std::size_t thread_shard()
+        {
+            static thread_local std::size_t const shard = next_shard();
+            return shard;
+        }
+
+    } // namespace impl
+
+    // Counter that threads add to without sharing a cache line, as long as
+    // there are at most impl::shard_count of them. Read it with sum() once
+    // the adding is over, e.g. at the end of a generation.
+    class sharded_counter{
+    private:
+        struct alignas(64) shard{
+            std::atomic<std::size_t> value;
+        };
+        shard shards[impl::shard_count];
+
+    public:
+        sharded_counter()
+        {
+            reset();
+        }
+
+        sharded_counter(sharded_counter const&) = delete;
+        sharded_counter& operator=(sharded_counter const&) = delete;
+
+        void add(std::size_t const n)
+        {
+            shards[impl::thread_shard()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        std::size_t sum() const
+        {
+            std::size_t retval = 0;
+            for(auto const& s : shards){
+                retval += s.value.load(std::memory_order_relaxed);
+            }
+            return retval;
+        }
+
+        void reset()
+        {
+            for(auto &s : shards){
+                s.value.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // Adds the time from construction to destruction to *seconds, if not null.
+    class scoped_timer{
+    private:
+        typedef std::chrono::steady_clock clock_type;
+        double* seconds;
+        clock_type::time_point start;
+
+    public:
+        explicit scoped_timer(double* const seconds_)
+            : seconds(seconds_), start(seconds_ ? clock_type::now() : clock_type::time_point())
+        {}
+
+        scoped_timer(scoped_timer const&) = delete;
+        scoped_timer& operator=(scoped_timer const&) = delete;
+
+        ~scoped_timer()
+        {
+            if(seconds){
+                *seconds += std::chrono::duration<double>(clock_type::now() - start).count();
+            }
+        }
+    };
+
+    // Counts of values by bucket, with their mean and maximum.
+    struct histogram{
+        std::vector<std::size_t> counts;
+        double mean;
+        std::size_t max;
+
+        histogram() : counts(), mean(0), max(0) {}
+
+        // bucket i counts the values in [2^i, 2^(i+1)), bucket 0 also 0
+        static std::size_t log2_bucket(std::size_t value)
+        {
+            std::size_t retval = 0;
+            while(value > 1){
+                value >>= 1;
+                ++retval;
+            }
+            return retval;
+        }
+
+        void add(std::size_t const bucket, std::size_t const value)
+        {
+            if(counts.size() <= bucket){
+                counts.resize(bucket + 1, 0);
+            }
+            ++counts[bucket];
+            mean += static_cast<double>(value);
+            max = std::max(max, value);
+        }
+
+        // turns the sum of the values into their mean
+        void finish(std::size_t const count)
+        {
+            if(count != 0){
+                mean /= static_cast<double>(count);
+            }
+        }
+    };
+
+    // What a population did during one generation.
+    struct generation_metrics{
+        std::size_t generation;
+
+        // wall time, in seconds
+        double selection_seconds;
+        double breeding_seconds;
+        double evaluation_seconds;
+        double total_seconds;
+
+        std::size_t evaluated;          // individuals scored on the training data
+        std::size_t table_hits;         // individuals scored from the fitness table
+        std::size_t rejected;           // scoring stopped early
+        std::size_t duplicates;         // scored from a behavioural twin, see config::semantic_probe_rows
+        std::size_t culled;             // offspring bred again, see config::semantic_culling
+        std::size_t nodes_evaluated;    // tree nodes times rows scored on
+        double fitness_table_hit_rate;  // of the lookups this generation
+        double eval_cache_hit_rate;     // of the subtree cache lookups this generation
+        double duplicate_rate;          // of the individuals scored, those taken from the fitness table or a twin
+
+        std::size_t allocations;        // tree nodes allocated from the per-thread pools
+        std::size_t node_bytes;         // in use in the per-thread pools at the end
+
+        histogram size;                 // nodes per tree, log2 buckets
+        histogram depth;                // depth per tree, one bucket per depth
+
+        double best_fitness;
+
+        generation_metrics()
+            : generation(0),
+              selection_seconds(0), breeding_seconds(0), evaluation_seconds(0), total_seconds(0),
+              evaluated(0), table_hits(0), rejected(0), duplicates(0), culled(0), nodes_evaluated(0),
+              fitness_table_hit_rate(0), eval_cache_hit_rate(0), duplicate_rate(0),
+              allocations(0), node_bytes(0), size(), depth(),
+              best_fitness(std::numeric_limits<double>::quiet_NaN())
+        {}
+    };
+
+    namespace impl {
+
+        inline void write_number(std::ostream &os, double const value)
+        {
+            if(std::isfinite(value)){
+                os << value;
+            }else{
+                os << "null";
+            }
+        }
+
+        inline void write_histogram(std::ostream &os, histogram const& h)
+        {
+            os << "{\"mean\":";
+            write_number(os, h.mean);
+            os << ",\"max\":" << h.max << ",\"counts\":[";
+            for(std::size_t i = 0; i < h.counts.size(); ++i){
+                os << (i ? "," : "") << h.counts[i];
+            }
+            os << "]}";
+        }
+
+    } // namespace impl
+
+    // m as one line of JSON, without the newline
+    inline std::string to_json(generation_metrics const& m)
+    {
+        std::ostringstream os;
+        os.precision(std::numeric_limits<double>::max_digits10);
+        os << "{\"generation\":" << m.generation
+           << ",\"seconds\":{\"selection\":";
+        impl::write_number(os, m.selection_seconds);
+        os << ",\"breeding\":";
+        impl::write_number(os, m.breeding_seconds);
+        os << ",\"evaluation\":";
+        impl::write_number(os, m.evaluation_seconds);
+        os << ",\"total\":";
+        impl::write_number(os, m.total_seconds);
+        os << "},\"evaluated\":" << m.evaluated
+           << ",\"table_hits\":" << m.table_hits
+           << ",\"rejected\":" << m.rejected
+           << ",\"duplicates\":" << m.duplicates
+           << ",\"culled\":" << m.culled
+           << ",\"nodes_evaluated\":" << m.nodes_evaluated
+           << ",\"fitness_table_hit_rate\":";
+        impl::write_number(os, m.fitness_table_hit_rate);
+        os << ",\"eval_cache_hit_rate\":";
+        impl::write_number(os, m.eval_cache_hit_rate);
+        os << ",\"duplicate_rate\":";
+        impl::write_number(os, m.duplicate_rate);
+        os << ",\"allocations\":" << m.allocations
+           << ",\"node_bytes\":" << m.node_bytes
+           << ",\"size\":";
+        impl::write_histogram(os, m.size);
+        os << ",\"depth\":";
+        impl::write_histogram(os, m.depth);
+        os << ",\"best_fitness\":";
+        impl::write_number(os, m.best_fitness);
+        os << "}";
+        return os.str();
+    }
+
+    // Callback writing each generation's metrics as a line of JSON.
+    class jsonl_writer{
+    private:
+        std::ostream* os;
+
+    public:
+        explicit jsonl_writer(std::ostream &os_) : os(&os_) {}
+
+        void operator()(generation_metrics const& m) const
+        {
+            *os << to_json(m) << '\n';
+            os->flush();
+        }
+    };
+
+} // namespace metrics
+
+} // namespace gene
+
+#endif    // GENE_METRICS_HPP_INCLUDED
@@ -2,9 +2,12 @@
 #define      GENE_NODE_HPP_INCLUDED
 
 #include "operators.hpp"
+#include "hash.hpp"
 
 #include <memory>
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <cstddef>
 
 #include <boost/variant.hpp>
@@ -15,11 +18,89 @@ namespace tree {
 
     typedef std::size_t Variable;
 
-    std::string variable_name(Variable v)
+    inline std::string variable_name(Variable v)
     {
         return "x" + std::to_string(v);
     }
 
+    // largest arity a knot can have, see child_list
+    constexpr std::size_t max_knot_arity = 3;
+
+    // Children of a knot, held in the knot itself so that a knot takes a
+    // single allocation, that of its node. At most max_knot_arity of them.
+    template<class Ptr>
+    class child_list{
+    public:
+        typedef Ptr value_type;
+        typedef Ptr* iterator;
+        typedef Ptr const* const_iterator;
+
+    private:
+        std::array<Ptr, max_knot_arity> items;
+        std::size_t count;
+
+    public:
+        child_list() : items(), count(0) {}
+
+        void push_back(Ptr p)
+        {
+            if(count == max_knot_arity){
+                throw("gene::tree::child_list::push_back: too many children.");
+            }
+            items[count++] = std::move(p);
+        }
+
+        std::size_t size() const
+        {
+            return count;
+        }
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+
+        Ptr& operator[](std::size_t const i)
+        {
+            return items[i];
+        }
+
+        Ptr const& operator[](std::size_t const i) const
+        {
+            return items[i];
+        }
+
+        iterator begin()
+        {
+            return items.data();
+        }
+
+        iterator end()
+        {
+            return items.data() + count;
+        }
+
+        const_iterator begin() const
+        {
+            return items.data();
+        }
+
+        const_iterator end() const
+        {
+            return items.data() + count;
+        }
+
+        bool operator==(child_list const& other) const
+        {
+            return count == other.count && std::equal(begin(), end(), other.begin());
+        }
+
+        bool operator!=(child_list const& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
     template<class V>
     class knot;
 
@@ -28,35 +109,70 @@ namespace tree {
 
     enum node_property {constant_value = 0, knot_value, variable_value};
 
+    // Structural hashes: equal subtrees have equal hashes.
     template<class V>
-    class knot{
-    private:
-        struct get_arity : boost::static_visitor<std::size_t>{
-            template<class Operator>
-            std::size_t operator()(Operator const&) const
-            {
-                return Operator::arity;
-            }
-        };
+    std::size_t constant_hash(V const& v)
+    {
+        return hash::combine(constant_value, hash::value(v));
+    }
+
+    inline std::size_t variable_hash(Variable const v)
+    {
+        return hash::combine(variable_value, v);
+    }
 
+    inline std::size_t knot_hash_seed(std::size_t const op_index)
+    {
+        return hash::combine(knot_value, op_index);
+    }
+
+    template<class V>
+    std::size_t node_hash(node<V> const& n);
+
+    template<class V>
+    std::size_t node_size(node<V> const& n);
+
+    template<class V>
+    std::size_t node_depth(node<V> const& n);
+
+    // Operator node: op is the operator's index in the primitive set of the
+    // tree it belongs to, see operators::primitive_set.
+    template<class V>
+    class knot{
     public:
         typedef
-            typename operators::operator_type
-            operator_type;
-        typedef
-            std::vector<std::shared_ptr<node<V>>>
+            child_list<std::shared_ptr<node<V>>>
             children_type;
 
     public:
-        operator_type op;
+        std::size_t op;
         std::size_t arity;
         children_type children;
+        // summary of this subtree, see rehash()
+        std::size_t hash;   // structural hash
+        std::size_t size;   // number of nodes
+        std::size_t depth;  // longest path to a leaf, 0 for leaves
 
     public:
-        knot(operator_type op_)
-            : op(op_), arity(boost::apply_visitor(get_arity(), op_)), children()
+        knot(std::size_t const op_, std::size_t const arity_)
+            : op(op_), arity(arity_), children(), hash(0), size(1), depth(1)
         {}
 
+        // recomputes hash, size and depth from the children, which must be
+        // up to date themselves
+        void rehash()
+        {
+            hash = knot_hash_seed(op);
+            size = 1;
+            depth = 0;
+            for(auto const& child : children){
+                hash = hash::combine(hash, node_hash(*child));
+                size += node_size(*child);
+                depth = std::max(depth, node_depth(*child));
+            }
+            depth += 1;
+        }
+
         template<class... Args>
         void set_children(Args... children_ptrs)
         {
@@ -66,10 +182,34 @@ namespace tree {
             for(auto child_ptr : {children_ptrs...}){
                 children.push_back(child_ptr);
             }
+            rehash();
         }
 
     };
 
+    template<class V>
+    std::size_t node_hash(node<V> const& n)
+    {
+        switch(n.which()){
+        case constant_value: return constant_hash(boost::get<V>(n));
+        case knot_value: return boost::get<knot<V>>(n).hash;
+        case variable_value: return variable_hash(boost::get<Variable>(n));
+        default: throw("gene::tree::node_hash: invalid node value.");
+        }
+    }
+
+    template<class V>
+    std::size_t node_size(node<V> const& n)
+    {
+        return n.which() == knot_value ? boost::get<knot<V>>(n).size : 1;
+    }
+
+    template<class V>
+    std::size_t node_depth(node<V> const& n)
+    {
+        return n.which() == knot_value ? boost::get<knot<V>>(n).depth : 0;
+    }
+
 } // namespace tree
 
 } // namespace gene
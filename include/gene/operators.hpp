@@ -2,26 +2,28 @@
 #define      GENE_OPERATORS_HPP_INCLUDED
 
 #include "config.hpp"
+#include "simd.hpp"
+#include "random.hpp"
+#include "util.hpp"
+#include "interval.hpp"
 
 #include <vector>
 #include <string>
 #include <memory>
-#include <random>
+#include <type_traits>
 
 #include <cstddef>
 #include <cmath>
 #include <cstdlib>
 
-#include <boost/variant.hpp>
-#include <boost/variant/static_visitor.hpp>
-
 namespace gene {
 
 namespace tree {
 
     namespace operators {
 
-        struct plus{
+        template<class Dummy = void>
+        struct basic_plus{
             static constexpr std::size_t arity = 2;
 
             template<class T>
@@ -38,11 +40,39 @@ namespace tree {
                 return "( " + children_strs[0] + " + " + children_strs[1] + " )";
             }
 
-            static char const symbol[];
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "(" + a[0] + " + " + a[1] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const, T const)
+            {
+                d[0] = T(1);
+                d[1] = T(1);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a, intervals::interval<T> const& b)
+            {
+                return a + b;
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, T const* b, std::size_t const n)
+            {
+                simd::add(out, a, b, n);
+            }
+
+            static constexpr char symbol[] = "plus";
         };
-        char const plus::symbol[] = "plus";
+        // a template, so that every translation unit may define the symbol
+        template<class Dummy>
+        constexpr char basic_plus<Dummy>::symbol[];
+        typedef basic_plus<> plus;
 
-        struct minus{
+        template<class Dummy = void>
+        struct basic_minus{
             static constexpr std::size_t arity = 2;
 
             template<class T>
@@ -59,11 +89,38 @@ namespace tree {
                 return "( " + children_strs[0] + " - " + children_strs[1] + " )";
             }
 
-            static char const symbol[];
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "(" + a[0] + " - " + a[1] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const, T const)
+            {
+                d[0] = T(1);
+                d[1] = T(-1);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a, intervals::interval<T> const& b)
+            {
+                return a - b;
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, T const* b, std::size_t const n)
+            {
+                simd::sub(out, a, b, n);
+            }
+
+            static constexpr char symbol[] = "minus";
         };
-        char const minus::symbol[] = "minus";
+        template<class Dummy>
+        constexpr char basic_minus<Dummy>::symbol[];
+        typedef basic_minus<> minus;
 
-        struct mult{
+        template<class Dummy = void>
+        struct basic_mult{
             static constexpr std::size_t arity = 2;
 
             template<class T>
@@ -80,11 +137,38 @@ namespace tree {
                 return "( " + children_strs[0] + " * " + children_strs[1] + " )";
             }
 
-            static char const symbol[];
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "(" + a[0] + " * " + a[1] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a, T const b)
+            {
+                d[0] = b;
+                d[1] = a;
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a, intervals::interval<T> const& b)
+            {
+                return a * b;
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, T const* b, std::size_t const n)
+            {
+                simd::mul(out, a, b, n);
+            }
+
+            static constexpr char symbol[] = "mult";
         };
-        char const mult::symbol[] = "mult";
+        template<class Dummy>
+        constexpr char basic_mult<Dummy>::symbol[];
+        typedef basic_mult<> mult;
 
-        struct divide{
+        template<class Dummy = void>
+        struct basic_divide{
             static constexpr std::size_t arity = 2;
 
             template<class T>
@@ -101,11 +185,38 @@ namespace tree {
                 return "( " + children_strs[0] + " / " + children_strs[1] + " )";
             }
 
-            static char const symbol[];
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "(" + a[0] + " / " + a[1] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a, T const b)
+            {
+                d[0] = T(1) / b;
+                d[1] = -a / (b * b);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a, intervals::interval<T> const& b)
+            {
+                return a / b;
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, T const* b, std::size_t const n)
+            {
+                simd::div(out, a, b, n);
+            }
+
+            static constexpr char symbol[] = "div";
         };
-        char const divide::symbol[] = "div";
+        template<class Dummy>
+        constexpr char basic_divide<Dummy>::symbol[];
+        typedef basic_divide<> divide;
 
-        struct abs{
+        template<class Dummy = void>
+        struct basic_abs{
             static constexpr std::size_t arity = 1;
 
             template<class T>
@@ -122,11 +233,37 @@ namespace tree {
                 return "abs( " + children_strs[0] + " )";
             }
 
-            static char const symbol[];
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "std::abs(" + a[0] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a)
+            {
+                d[0] = a < T(0) ? T(-1) : T(1);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a)
+            {
+                return intervals::abs(a);
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, std::size_t const n)
+            {
+                simd::abs(out, a, n);
+            }
+
+            static constexpr char symbol[] = "abs";
         };
-        char const abs::symbol[] = "abs";
+        template<class Dummy>
+        constexpr char basic_abs<Dummy>::symbol[];
+        typedef basic_abs<> abs;
 
-        struct sqrt{
+        template<class Dummy = void>
+        struct basic_sqrt{
             static constexpr std::size_t arity = 1;
 
             template<class T>
@@ -143,44 +280,553 @@ namespace tree {
                 return "sqrt( " + children_strs[0] + " )";
             }
 
-            static char const symbol[];
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "std::sqrt(" + a[0] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a)
+            {
+                d[0] = T(0.5) / std::sqrt(a);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a)
+            {
+                return intervals::sqrt(a);
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, std::size_t const n)
+            {
+                simd::sqrt(out, a, n);
+            }
+
+            static constexpr char symbol[] = "sqrt";
         };
-        char const sqrt::symbol[] = "sqrt";
+        template<class Dummy>
+        constexpr char basic_sqrt<Dummy>::symbol[];
+        typedef basic_sqrt<> sqrt;
+
+        template<class Dummy = void>
+        struct basic_sin{
+            static constexpr std::size_t arity = 1;
+
+            template<class T>
+            T operator()(T const a) const
+            {
+                return std::sin(a);
+            }
+
+            std::string to_string(std::vector<std::string> const& children_strs) const
+            {
+                if(children_strs.size()!=arity){
+                    throw("sin::to_string: children size is invalid");
+                }
+                return "sin( " + children_strs[0] + " )";
+            }
+
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "std::sin(" + a[0] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a)
+            {
+                d[0] = std::cos(a);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a)
+            {
+                return intervals::sin(a);
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, std::size_t const n)
+            {
+                for(std::size_t i = 0; i < n; ++i){
+                    out[i] = std::sin(a[i]);
+                }
+            }
 
-        enum struct opset{
-            plus, minus, mult, div, abs, sqrt
+            static constexpr char symbol[] = "sin";
         };
+        template<class Dummy>
+        constexpr char basic_sin<Dummy>::symbol[];
+        typedef basic_sin<> sin;
+
+        template<class Dummy = void>
+        struct basic_cos{
+            static constexpr std::size_t arity = 1;
+
+            template<class T>
+            T operator()(T const a) const
+            {
+                return std::cos(a);
+            }
+
+            std::string to_string(std::vector<std::string> const& children_strs) const
+            {
+                if(children_strs.size()!=arity){
+                    throw("cos::to_string: children size is invalid");
+                }
+                return "cos( " + children_strs[0] + " )";
+            }
+
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "std::cos(" + a[0] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a)
+            {
+                d[0] = -std::sin(a);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a)
+            {
+                return intervals::cos(a);
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, std::size_t const n)
+            {
+                for(std::size_t i = 0; i < n; ++i){
+                    out[i] = std::cos(a[i]);
+                }
+            }
+
+            static constexpr char symbol[] = "cos";
+        };
+        template<class Dummy>
+        constexpr char basic_cos<Dummy>::symbol[];
+        typedef basic_cos<> cos;
+
+        template<class Dummy = void>
+        struct basic_exp{
+            static constexpr std::size_t arity = 1;
+
+            template<class T>
+            T operator()(T const a) const
+            {
+                return std::exp(a);
+            }
+
+            std::string to_string(std::vector<std::string> const& children_strs) const
+            {
+                if(children_strs.size()!=arity){
+                    throw("exp::to_string: children size is invalid");
+                }
+                return "exp( " + children_strs[0] + " )";
+            }
+
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "std::exp(" + a[0] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a)
+            {
+                d[0] = std::exp(a);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a)
+            {
+                return intervals::exp(a);
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, std::size_t const n)
+            {
+                for(std::size_t i = 0; i < n; ++i){
+                    out[i] = std::exp(a[i]);
+                }
+            }
+
+            static constexpr char symbol[] = "exp";
+        };
+        template<class Dummy>
+        constexpr char basic_exp<Dummy>::symbol[];
+        typedef basic_exp<> exp;
+
+        // natural logarithm
+        template<class Dummy = void>
+        struct basic_log{
+            static constexpr std::size_t arity = 1;
+
+            template<class T>
+            T operator()(T const a) const
+            {
+                return std::log(a);
+            }
+
+            std::string to_string(std::vector<std::string> const& children_strs) const
+            {
+                if(children_strs.size()!=arity){
+                    throw("log::to_string: children size is invalid");
+                }
+                return "log( " + children_strs[0] + " )";
+            }
+
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "std::log(" + a[0] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a)
+            {
+                d[0] = T(1) / a;
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a)
+            {
+                return intervals::log(a);
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, std::size_t const n)
+            {
+                for(std::size_t i = 0; i < n; ++i){
+                    out[i] = std::log(a[i]);
+                }
+            }
+
+            static constexpr char symbol[] = "log";
+        };
+        template<class Dummy>
+        constexpr char basic_log<Dummy>::symbol[];
+        typedef basic_log<> log;
+
+        // a / b, or 1 when b is 0
+        template<class Dummy = void>
+        struct basic_protected_divide{
+            static constexpr std::size_t arity = 2;
+
+            template<class T>
+            T operator()(T const a, T const b) const
+            {
+                return b == T(0) ? T(1) : a / b;
+            }
+
+            std::string to_string(std::vector<std::string> const& children_strs) const
+            {
+                if(children_strs.size()!=arity){
+                    throw("protected_divide::to_string: children size is invalid");
+                }
+                return "pdiv( " + children_strs[0] + ", " + children_strs[1] + " )";
+            }
+
+            // a[1] appears twice, codegen passes names and literals only
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "(" + a[1] + " == 0 ? 1 : " + a[0] + " / " + a[1] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a, T const b)
+            {
+                d[0] = b == T(0) ? T(0) : T(1) / b;
+                d[1] = b == T(0) ? T(0) : -a / (b * b);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a, intervals::interval<T> const& b)
+            {
+                return intervals::protected_divide(a, b);
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, T const* b, std::size_t const n)
+            {
+                for(std::size_t i = 0; i < n; ++i){
+                    out[i] = b[i] == T(0) ? T(1) : a[i] / b[i];
+                }
+            }
+
+            static constexpr char symbol[] = "pdiv";
+        };
+        template<class Dummy>
+        constexpr char basic_protected_divide<Dummy>::symbol[];
+        typedef basic_protected_divide<> protected_divide;
+
+        // b if a > 0, c otherwise
+        template<class Dummy = void>
+        struct basic_if_positive{
+            static constexpr std::size_t arity = 3;
+
+            template<class T>
+            T operator()(T const a, T const b, T const c) const
+            {
+                return a > T(0) ? b : c;
+            }
+
+            std::string to_string(std::vector<std::string> const& children_strs) const
+            {
+                if(children_strs.size()!=arity){
+                    throw("if_positive::to_string: children size is invalid");
+                }
+                return "( " + children_strs[0] + " > 0 ? " + children_strs[1] + " : " + children_strs[2] + " )";
+            }
+
+            static std::string to_cpp(std::vector<std::string> const& a)
+            {
+                return "(" + a[0] + " > 0 ? " + a[1] + " : " + a[2] + ")";
+            }
+
+            template<class T>
+            static void partials(T* d, T const a, T const, T const)
+            {
+                d[0] = T(0);
+                d[1] = a > T(0) ? T(1) : T(0);
+                d[2] = a > T(0) ? T(0) : T(1);
+            }
+
+            template<class T>
+            static intervals::interval<T> range(intervals::interval<T> const& a, intervals::interval<T> const& b, intervals::interval<T> const& c)
+            {
+                return intervals::if_positive(a, b, c);
+            }
+
+            template<class T>
+            static void kernel(T* out, T const* a, T const* b, T const* c, std::size_t const n)
+            {
+                for(std::size_t i = 0; i < n; ++i){
+                    out[i] = a[i] > T(0) ? b[i] : c[i];
+                }
+            }
+
+            static constexpr char symbol[] = "if_positive";
+        };
+        template<class Dummy>
+        constexpr char basic_if_positive<Dummy>::symbol[];
+        typedef basic_if_positive<> if_positive;
+
+        namespace impl {
+
+            constexpr std::size_t max_of()
+            {
+                return 0;
+            }
+
+            template<class... Rest>
+            constexpr std::size_t max_of(std::size_t const first, Rest const... rest)
+            {
+                return first > max_of(rest...) ? first : max_of(rest...);
+            }
+
+            // position of Op in Ops..., or sizeof...(Ops) if it is not there
+            template<class Op, class... Ops>
+            struct index_of : std::integral_constant<std::size_t, 0> {};
+
+            template<class Op, class... Rest>
+            struct index_of<Op, Op, Rest...> : std::integral_constant<std::size_t, 0> {};
+
+            template<class Op, class First, class... Rest>
+            struct index_of<Op, First, Rest...>
+                : std::integral_constant<std::size_t, 1 + index_of<Op, Rest...>::value> {};
+
+            // Op applied to args[0], ..., args[Op::arity - 1]
+            template<class Op, class T, std::size_t... Indices>
+            T apply(T const* args, util::index_tuple<Indices...>)
+            {
+                return Op()(args[Indices]...);
+            }
+
+            template<class Op, class T>
+            T apply(T const* args)
+            {
+                return apply<Op>(args, util::idx_range<0, Op::arity>());
+            }
+
+            // Op's vector kernel over n rows of args[0], ..., args[Op::arity - 1]
+            template<class Op, class T, std::size_t... Indices>
+            void kernel(T* out, T const* const* args, std::size_t const n, util::index_tuple<Indices...>)
+            {
+                Op::kernel(out, args[Indices]..., n);
+            }
+
+            template<class Op, class T>
+            void kernel(T* out, T const* const* args, std::size_t const n)
+            {
+                kernel<Op>(out, args, n, util::idx_range<0, Op::arity>());
+            }
+
+            // d[i][r] = partial derivative of Op by its operand i at row r
+            // of args, for n rows
+            template<class Op, class T, std::size_t... Indices>
+            void partials(T* const* d, T const* const* args, std::size_t const n, util::index_tuple<Indices...>)
+            {
+                T row[Op::arity];
+                for(std::size_t r = 0; r < n; ++r){
+                    Op::partials(row, args[Indices][r]...);
+                    for(std::size_t i = 0; i < Op::arity; ++i){
+                        d[i][r] = row[i];
+                    }
+                }
+            }
+
+            template<class Op, class T>
+            void partials(T* const* d, T const* const* args, std::size_t const n)
+            {
+                partials<Op>(d, args, n, util::idx_range<0, Op::arity>());
+            }
+
+            template<class Op, class T, std::size_t... Indices>
+            intervals::interval<T> range(intervals::interval<T> const* args, util::index_tuple<Indices...>)
+            {
+                return Op::range(args[Indices]...);
+            }
+
+            template<class Op, class T>
+            intervals::interval<T> range(intervals::interval<T> const* args)
+            {
+                return range<Op>(args, util::idx_range<0, Op::arity>());
+            }
+
+            template<class Op>
+            std::string to_string(std::vector<std::string> const& args)
+            {
+                return Op().to_string(args);
+            }
+
+            template<class Op>
+            std::string to_cpp(std::vector<std::string> const& args)
+            {
+                return Op::to_cpp(args);
+            }
+
+        } // namespace impl
+
+        // The operators trees are built from, fixed at compile time. Knots
+        // store the index of their operator in Primitives..., and every
+        // per-operator function is looked up in a table generated here, one
+        // entry per operator, each specialized for the operator's arity.
+        //
+        // A primitive is a class with
+        //   static constexpr std::size_t arity;           // at least 1
+        //   static char const symbol[];                   // defined once per program
+        //   T operator()(T a, ...) const;                 // arity arguments
+        //   std::string to_string(std::vector<std::string> const& args) const;
+        //   static std::string to_cpp(std::vector<std::string> const& args);
+        //                                                 // C++ source, see codegen.hpp
+        //   static void kernel(T* out, T const* a, ..., std::size_t n);
+        //                                                 // out[i] = op(a[i], ...)
+        // and, for autodiff.hpp and range_analysis.hpp only,
+        //   static void partials(T* d, T a, ...);         // d[i] = d op / d operand i
+        //   static intervals::interval<T> range(intervals::interval<T> const& a, ...);
+        //                                                 // values op takes over a, ...
+        template<class... Primitives>
+        struct primitive_set{
+            static_assert(sizeof...(Primitives) > 0, "gene::tree::operators::primitive_set: no primitives");
+            static_assert(impl::max_of(Primitives::arity...) > 0, "gene::tree::operators::primitive_set: primitives need operands");
+
+            static constexpr std::size_t size = sizeof...(Primitives);
+            static constexpr std::size_t max_arity = impl::max_of(Primitives::arity...);
+
+            template<class T>
+            using scalar_function = T (*)(T const*);
+
+            template<class T>
+            using kernel_function = void (*)(T*, T const* const*, std::size_t);
+
+            // index of Op, size if it is not in the set
+            template<class Op>
+            struct index_of : impl::index_of<Op, Primitives...> {};
+
+            template<class Op>
+            struct contains : std::integral_constant<bool, index_of<Op>::value != size> {};
+
+            static std::size_t arity(std::size_t const index)
+            {
+                static std::size_t const table[] = { Primitives::arity... };
+                return table[index];
+            }
+
+            static char const* symbol(std::size_t const index)
+            {
+                static char const* const table[] = { Primitives::symbol... };
+                return table[index];
+            }
+
+            static std::string to_string(std::size_t const index, std::vector<std::string> const& args)
+            {
+                typedef std::string (*function)(std::vector<std::string> const&);
+                static function const table[] = { &impl::to_string<Primitives>... };
+                return table[index](args);
+            }
+
+            static std::string to_cpp(std::size_t const index, std::vector<std::string> const& args)
+            {
+                typedef std::string (*function)(std::vector<std::string> const&);
+                static function const table[] = { &impl::to_cpp<Primitives>... };
+                return table[index](args);
+            }
+
+            // entry i computes operator i from its arity(i) operands
+            template<class T>
+            static scalar_function<T> const* scalar_table()
+            {
+                static scalar_function<T> const table[] = { &impl::apply<Primitives, T>... };
+                return table;
+            }
+
+            template<class T>
+            static T apply(std::size_t const index, T const* args)
+            {
+                return scalar_table<T>()[index](args);
+            }
+
+            // out = operator index over n rows of the columns args[0], ...
+            template<class T>
+            static void kernel(std::size_t const index, T* out, T const* const* args, std::size_t const n)
+            {
+                static kernel_function<T> const table[] = { &impl::kernel<Primitives, T>... };
+                table[index](out, args, n);
+            }
+
+            // d[i][r] = partial derivative of operator index by its operand i
+            // at row r of the columns args[0], ...
+            template<class T>
+            static void partials(std::size_t const index, T* const* d, T const* const* args, std::size_t const n)
+            {
+                typedef void (*function)(T* const*, T const* const*, std::size_t);
+                static function const table[] = { &impl::partials<Primitives, T>... };
+                table[index](d, args, n);
+            }
+
+            // range of operator index over operands in args[0], ...
+            template<class T>
+            static intervals::interval<T> range(std::size_t const index, intervals::interval<T> const* args)
+            {
+                typedef intervals::interval<T> (*function)(intervals::interval<T> const*);
+                static function const table[] = { &impl::range<Primitives, T>... };
+                return table[index](args);
+            }
+
+            static std::size_t random_index()
+            {
+                return random::uniform_index(size);
+            }
+        };
+
+        template<class... Primitives>
+        constexpr std::size_t primitive_set<Primitives...>::size;
+
+        template<class... Primitives>
+        constexpr std::size_t primitive_set<Primitives...>::max_arity;
 
-        boost::variant<plus, minus, mult, divide, abs, sqrt>
-        op(opset const sym)
-        {
-            switch(sym){
-            case opset::plus: return plus();
-            case opset::minus: return minus();
-            case opset::mult: return mult();
-            case opset::div: return divide();
-            case opset::abs: return abs();
-            case opset::sqrt: return sqrt();
-            default: throw("illegal operator");
-            }
-        }
-
-        boost::variant<plus, minus, mult, divide, abs, sqrt>
-        random_op()
-        {
-            std::uniform_int_distribution<int> dst( static_cast<int>(opset::plus),
-                                                    static_cast<int>(opset::sqrt));
-            return op(static_cast<opset>(dst(gene::config::random_engine)));
-        }
-
-        typedef
-            boost::variant< operators::plus,
-                            operators::minus,
-                            operators::mult,
-                            operators::divide,
-                            operators::abs,
-                            operators::sqrt >
-            operator_type;
+        // the operators used when no primitive set is given; their order is
+        // the operator numbering of saved trees
+        typedef primitive_set<plus, minus, mult, divide, abs, sqrt> default_primitives;
 
     } // namespace operators
 
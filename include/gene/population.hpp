@@ -5,52 +5,1139 @@
 #include "util.hpp"
 #include "random_term.hpp"
 #include "individual.hpp"
+#include "hashcons.hpp"
+#include "batch.hpp"
+#include "eval_cache.hpp"
+#include "fitness_table.hpp"
+#include "thread_pool.hpp"
+#include "random.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
 
 #include <cstddef>
 #include <vector>
 #include <array>
 #include <tuple>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <unordered_set>
+#include <unordered_map>
 
 namespace gene {
 
 template< class ValueType,
           std::size_t InputSize,
           std::size_t OutputSize,
-          class RandomTermGenerator = random_term::default_random_term<ValueType> >
+          class RandomTermGenerator = random_term::default_random_term<ValueType>,
+          class Primitives = tree::operators::default_primitives >
 class population{
 public:
-    typedef individual::individual<ValueType, InputSize, OutputSize, RandomTermGenerator> individual_type;
+    typedef individual::individual<ValueType, InputSize, OutputSize, RandomTermGenerator, Primitives> individual_type;
+    typedef fitness_table<ValueType, typename individual_type::flat_key_type, typename individual_type::same_structure> memo_type;
+
+    // what the last evaluate() call did
+    struct evaluation_statistics{
+        std::size_t generation;
+        std::size_t unchanged;  // fitness still valid, nothing to do
+        std::size_t table_hits; // fitness found in the fitness_table
+        std::size_t evaluated;  // fitness computed over the training data
+        std::size_t simplified_nodes;   // removed by config::simplify_before_evaluation
+        std::size_t rejected;   // evaluation stopped early, see config::early_abort
+        std::size_t rows_skipped;       // training rows the rejected ones were spared
+        std::size_t sample_rows;        // rows scored on, fewer than all with config::minibatch_rows
+        std::size_t tuned;      // constants fitted, see config::tune_elites
+        std::size_t undefined;  // given the worst fitness unscored, see config::interval_rejection
+        std::size_t duplicates; // fitness taken from a behavioural twin, see config::semantic_probe_rows
+        std::size_t culled;     // offspring bred again before this evaluation, see config::semantic_culling
+    };
 
 private:
-    std::vector< std::pair<
-                    std::array<ValueType, InputSize>,
-                    std::array<ValueType, OutputSize>
-               > > training_data;
+    batch::columns<ValueType> input_columns;
+    batch::columns<ValueType> output_columns;
     std::vector<individual_type> individuals;
     std::size_t generation = 0;
+    std::shared_ptr<thread_pool> pool;
+    bool serial = false;
+    std::shared_ptr<tree::hashcons_table<ValueType>> table;
+    std::shared_ptr<batch::subtree_cache<ValueType>> cache;
+    std::shared_ptr<memo_type> fitnesses;
+    evaluation_statistics last_evaluation = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+    // mini-batch mode: the subsample scored on this generation, the
+    // shuffled row order it is taken from, and the best individual seen,
+    // scored on all rows
+    batch::columns<ValueType> sample_inputs;
+    batch::columns<ValueType> sample_outputs;
+    std::vector<std::size_t> sample_order;
+    std::size_t sample_cursor = 0;
+    std::size_t sample_rows = 0;
+    std::size_t sample_generation = no_sample;
+    std::shared_ptr<individual_type const> best_of_run;
+
+    // range of each training input, for config::interval_folding and
+    // config::interval_rejection; empty until needed
+    std::vector<intervals::interval<ValueType>> input_ranges;
+
+    // semantic deduplication: the probe rows, the fitness of each
+    // fingerprint seen, and the offspring culled since the last evaluation
+    batch::columns<ValueType> probe_inputs;
+    std::shared_ptr<fitness_table<ValueType>> twins;
+    std::size_t culled = 0;
+
+    // metrics of the generation under way, collected while a callback is set
+    std::function<void(metrics::generation_metrics const&)> metrics_callback;
+    std::shared_ptr<metrics::sharded_counter> nodes_evaluated;
+    metrics::generation_metrics current_metrics;
+    memory::statistics metrics_memory_start;
+    typename batch::subtree_cache<ValueType>::statistics metrics_cache_start;
+
+    // called on the elite_callback_count best individuals after evaluations
+    std::function<void(individual_type &)> elite_callback;
+    std::size_t elite_callback_count = 0;
+
+    // scratch space of next_generation(), kept to avoid reallocations
+    std::vector<individual_type> offspring;
+    std::vector<std::size_t> order;
 
 private:
+    static constexpr std::size_t no_sample = static_cast<std::size_t>(-1);
+
+    struct evaluation_counters{
+        std::atomic<std::size_t> unchanged;
+        std::atomic<std::size_t> table_hits;
+        std::atomic<std::size_t> evaluated;
+        std::atomic<std::size_t> simplified_nodes;
+        std::atomic<std::size_t> rejected;
+        std::atomic<std::size_t> rows_skipped;
+        std::atomic<std::size_t> undefined;
+        std::atomic<std::size_t> duplicates;
+
+        evaluation_statistics snapshot(std::size_t const generation) const
+        {
+            return {generation, unchanged, table_hits, evaluated, simplified_nodes, rejected, rows_skipped, 0, 0,
+                    undefined, duplicates, 0};
+        }
+    };
+
+    // Gives ind a valid fitness, from the cheapest source available.
+    // An individual sure to score above bound is rejected part way through.
+    // Returns false if its fitness is not what scoring would give, i.e.
+    // it was rejected either way.
+    bool evaluate_one(individual_type &ind, evaluation_counters &counters,
+                      ValueType const bound = individual_type::worst_fitness())
+    {
+        if(!ind.needs_evaluation()){
+            ++counters.unchanged;
+            return !ind.is_rejected();
+        }
+        if(config::simplify_before_evaluation){
+            if(table){
+                tree::scoped_table<ValueType> use(*table);
+                counters.simplified_nodes += ind.simplify();
+            }else{
+                counters.simplified_nodes += ind.simplify();
+            }
+        }
+        if(config::interval_folding){
+            if(table){
+                tree::scoped_table<ValueType> use(*table);
+                counters.simplified_nodes += ind.fold_invariants(input_ranges);
+            }else{
+                counters.simplified_nodes += ind.fold_invariants(input_ranges);
+            }
+        }
+        if(config::interval_rejection && ind.undefined_over(input_ranges, config::interval_rejection_strict)){
+            ind.set_fitness(individual_type::worst_fitness());
+            ++counters.undefined;
+            return false;
+        }
+        ValueType f;
+        if(fitnesses && fitnesses->find(ind.hash(), ind.flat_trees(), f)){
+            ind.set_fitness(f);
+            ++counters.table_hits;
+            return true;
+        }
+        std::size_t const skipped = ind.calc_fitness_bounded(scoring_inputs(), scoring_outputs(), bound, cache.get());
+        ++counters.evaluated;
+        if(nodes_evaluated){
+            std::size_t nodes = 0;
+            for(auto const& t : ind.get_trees()){
+                nodes += t.size();
+            }
+            nodes_evaluated->add(nodes * (scoring_inputs().rows() - skipped));
+        }
+        if(ind.is_rejected()){
+            // only a lower bound, not worth remembering
+            ++counters.rejected;
+            counters.rows_skipped += skipped;
+            return false;
+        }
+        if(fitnesses){
+            fitnesses->insert(ind.hash(), ind.flat_trees(), ind.fitness);
+        }
+        return true;
+    }
+
+    // gives ind the fitness of a twin scored before, if there is one
+    bool find_twin(individual_type &ind, evaluation_counters &counters)
+    {
+        std::size_t const fingerprint = ind.fingerprint(probe_inputs);
+        ValueType f;
+        if(!twins->find(fingerprint, fingerprint, f)){
+            return false;
+        }
+        ind.set_fitness(f);
+        ++counters.duplicates;
+        return true;
+    }
+
+    // evaluate_one() on the individuals at slots in parallel, each against
+    // its own bound, sharing fitness with twins from earlier evaluations
+    // (see evaluate()); twins is written afterwards in slot order, so the
+    // results do not depend on the thread timing
+    void evaluate_slots(std::vector<std::size_t> const& slots, std::vector<ValueType> const& bounds,
+                        evaluation_counters &counters)
+    {
+        std::size_t const n = slots.size();
+        std::vector<std::size_t> prints(n, 0);
+        std::vector<char> exact(n, 0);
+        for_each_index(n, [&](std::size_t const i){
+            auto &ind = individuals[slots[i]];
+            if(!twins || !ind.needs_evaluation()){
+                this->evaluate_one(ind, counters, bounds[i]);
+                return;
+            }
+            prints[i] = ind.fingerprint(probe_inputs);
+            exact[i] = this->find_twin(ind, counters) || this->evaluate_one(ind, counters, bounds[i]);
+        });
+        for(std::size_t i = 0; i < n; ++i){
+            if(exact[i]){
+                twins->insert(prints[i], prints[i], individuals[slots[i]].fitness);
+            }
+        }
+    }
+
+    // computes input_ranges from the training inputs, before the
+    // evaluations that use them run in parallel
+    void prepare_input_ranges()
+    {
+        if((config::interval_folding || config::interval_rejection) && input_ranges.empty()){
+            input_ranges = intervals::of_columns(input_columns);
+        }
+    }
+
+    // takes config::semantic_probe_rows training rows, evenly spaced, as
+    // the probe rows if they are needed and not taken yet
+    void prepare_probes()
+    {
+        std::size_t const rows = std::min(config::semantic_probe_rows, input_columns.rows());
+        if(!twins || probe_inputs.rows() == rows){
+            return;
+        }
+        probe_inputs = batch::columns<ValueType>(InputSize, rows);
+        for(std::size_t c = 0; c < InputSize; ++c){
+            ValueType const* from = input_columns.column(c);
+            ValueType* to = probe_inputs.column(c);
+            for(std::size_t r = 0; r < rows; ++r){
+                to[r] = from[r * input_columns.rows() / rows];
+            }
+        }
+    }
+
+    // true if no individual in fingerprints behaves like ind; adds it
+    bool novel(individual_type &ind, std::unordered_set<std::size_t> &fingerprints)
+    {
+        return fingerprints.insert(ind.fingerprint(probe_inputs)).second;
+    }
+
+    bool sampling() const
+    {
+        return config::minibatch_rows != 0;
+    }
+
+    batch::columns<ValueType> const& scoring_inputs() const
+    {
+        return sampling() ? sample_inputs : input_columns;
+    }
+
+    batch::columns<ValueType> const& scoring_outputs() const
+    {
+        return sampling() ? sample_outputs : output_columns;
+    }
+
+    template<class F>
+    void for_each_index(std::size_t const n, F f)
+    {
+        if(serial){
+            for(std::size_t i = 0; i < n; ++i){
+                f(i);
+            }
+        }else{
+            if(!pool){
+                pool = std::make_shared<thread_pool>(config::thread_count);
+            }
+            pool->parallel_for(0, n, f);
+        }
+    }
+
+    // Takes the next sample_rows rows of the shuffled row order as this
+    // generation's subsample, reshuffling once the order is used up, and
+    // makes every fitness stale.
+    void draw_sample()
+    {
+        std::size_t const rows = input_columns.rows();
+        sample_rows = std::min(std::max(sample_rows, config::minibatch_rows), rows);
+        if(sample_order.size() != rows){
+            sample_order.resize(rows);
+            std::iota(sample_order.begin(), sample_order.end(), 0);
+            sample_cursor = rows;
+        }
+        if(sample_cursor + sample_rows > rows){
+            for(std::size_t i = rows; i > 1; --i){
+                std::swap(sample_order[i - 1], sample_order[random::uniform_index(i)]);
+            }
+            sample_cursor = 0;
+        }
+        // in row order, for locality
+        std::vector<std::size_t> picked(sample_order.begin() + sample_cursor,
+                                        sample_order.begin() + sample_cursor + sample_rows);
+        std::sort(picked.begin(), picked.end());
+        sample_cursor += sample_rows;
+
+        sample_inputs = batch::columns<ValueType>(InputSize, sample_rows);
+        sample_outputs = batch::columns<ValueType>(OutputSize, sample_rows);
+        for(std::size_t c = 0; c < InputSize; ++c){
+            ValueType const* from = input_columns.column(c);
+            ValueType* to = sample_inputs.column(c);
+            for(std::size_t r = 0; r < sample_rows; ++r){
+                to[r] = from[picked[r]];
+            }
+        }
+        for(std::size_t c = 0; c < OutputSize; ++c){
+            ValueType const* from = output_columns.column(c);
+            ValueType* to = sample_outputs.column(c);
+            for(std::size_t r = 0; r < sample_rows; ++r){
+                to[r] = from[picked[r]];
+            }
+        }
+        sample_generation = generation;
+        forget_fitness();
+    }
+
+    // Scores copies of the config::minibatch_candidates best individuals of
+    // the subsample on all rows, keeps the best of them if it beats the
+    // best of the run, and adapts the subsample size to how often the two
+    // scores rank a pair of candidates differently. The individuals keep
+    // their subsample fitness, so that breeding compares like with like.
+    void rescore_candidates()
+    {
+        std::size_t const k = select_elites(std::max(config::minibatch_candidates, config::elite_count));
+        if(k == 0){
+            return;
+        }
+        std::vector<individual_type> rescored;
+        rescored.reserve(k);
+        for(std::size_t i = 0; i < k; ++i){
+            rescored.push_back(individuals[order[i]]);
+        }
+        for_each_index(k, [&](std::size_t const i){
+            rescored[i].calc_fitness(input_columns, output_columns);
+        });
+
+        std::size_t best = 0;
+        std::size_t pairs = 0, discordant = 0;
+        for(std::size_t i = 0; i < k; ++i){
+            if(rescored[i].fitness < rescored[best].fitness){
+                best = i;
+            }
+            for(std::size_t j = i + 1; j < k; ++j){
+                ++pairs;
+                if((individuals[order[i]].fitness < individuals[order[j]].fitness) != (rescored[i].fitness < rescored[j].fitness)){
+                    ++discordant;
+                }
+            }
+        }
+        if(!best_of_run || rescored[best].fitness < best_of_run->fitness){
+            best_of_run = std::make_shared<individual_type const>(std::move(rescored[best]));
+        }
+        if(pairs != 0){
+            double const noise = static_cast<double>(discordant) / static_cast<double>(pairs);
+            if(noise > config::minibatch_noise){
+                sample_rows = std::min(sample_rows * 2, input_columns.rows());
+            }else if(noise < config::minibatch_noise / 2){
+                sample_rows = std::max(sample_rows / 4 * 3, config::minibatch_rows);
+            }
+        }
+    }
+
+    // Fits the constants of the config::tune_elites best individuals that
+    // were not fitted yet, on the data they are scored on. Their fitness is
+    // then that of the fitted constants.
+    std::size_t tune_elites()
+    {
+        std::size_t const k = select_elites(config::tune_elites);
+        std::atomic<std::size_t> tuned(0);
+        for_each_index(k, [&](std::size_t const i){
+            auto &ind = individuals[order[i]];
+            if(ind.constants_tuned() || ind.is_rejected() || !(ind.fitness < individual_type::worst_fitness())){
+                return;
+            }
+            if(table){
+                tree::scoped_table<ValueType> use(*table);
+                ind.tune_constants(scoring_inputs(), scoring_outputs(), config::tune_iterations);
+            }else{
+                ind.tune_constants(scoring_inputs(), scoring_outputs(), config::tune_iterations);
+            }
+            if(fitnesses){
+                fitnesses->insert(ind.hash(), ind.flat_trees(), ind.fitness);
+            }
+            ++tuned;
+        });
+        return tuned;
+    }
+
+    // Scores every individual that needs it, rejecting those sure to score
+    // above bound. A fresh subsample makes every fitness stale, bound
+    // included: the individuals that were scored before it, e.g. elites,
+    // are then scored first without a bound, and the bound is taken again
+    // from their new fitness.
+    void evaluate_all(ValueType bound)
+    {
+        metrics::scoped_timer timer(timing(current_metrics.evaluation_seconds));
+        bool const fresh_sample = sampling() && sample_generation != generation;
+        std::vector<char> carried;
+        if(fresh_sample){
+            if(bound < individual_type::worst_fitness()){
+                carried.resize(individuals.size());
+                for(std::size_t i = 0; i < individuals.size(); ++i){
+                    carried[i] = !individuals[i].needs_evaluation();
+                }
+            }
+            draw_sample();
+        }
+        prepare_input_ranges();
+        prepare_probes();
+        evaluation_counters counters{};
+        if(!carried.empty()){
+            for_each_index(individuals.size(), [&](std::size_t const i){
+                if(carried[i]){
+                    this->evaluate_one(individuals[i], counters);
+                }
+            });
+            bound = rejection_bound();
+        }
+        if(twins){
+            // The first individual of each fingerprint is scored, or takes
+            // the fitness of a twin from an earlier evaluation; the others
+            // then copy its fitness unless it was rejected, in which case
+            // they are scored themselves. twins is only read while threads
+            // run and written afterwards in index order, so the results do
+            // not depend on the thread timing.
+            // Fingerprints are taken before simplification may change them.
+            std::size_t const n = individuals.size();
+            std::vector<std::size_t> prints(n, 0);
+            for_each_index(n, [&](std::size_t const i){
+                if(individuals[i].needs_evaluation()){
+                    prints[i] = individuals[i].fingerprint(probe_inputs);
+                }
+            });
+            std::vector<std::size_t> group(n, n);   // first individual of the fingerprint; n: unchanged
+            std::unordered_map<std::size_t, std::size_t> first;
+            for(std::size_t i = 0; i < n; ++i){
+                if(individuals[i].needs_evaluation()){
+                    group[i] = first.emplace(prints[i], i).first->second;
+                }
+            }
+            std::vector<char> exact(n, 0);
+            for_each_index(n, [&](std::size_t const i){
+                if(group[i] == n){
+                    if(carried.empty() || !carried[i]){
+                        this->evaluate_one(individuals[i], counters, bound);
+                    }
+                }else if(group[i] == i){
+                    exact[i] = this->find_twin(individuals[i], counters)
+                            || this->evaluate_one(individuals[i], counters, bound);
+                }
+            });
+            for(std::size_t i = 0; i < n; ++i){
+                if(group[i] == i && exact[i]){
+                    twins->insert(prints[i], prints[i], individuals[i].fitness);
+                }else if(group[i] < i && exact[group[i]]){
+                    individuals[i].set_fitness(individuals[group[i]].fitness);
+                    ++counters.duplicates;
+                }
+            }
+            for_each_index(n, [&](std::size_t const i){
+                if(group[i] < i && !exact[group[i]]){
+                    this->evaluate_one(individuals[i], counters, bound);
+                }
+            });
+        }else{
+            for_each_index(individuals.size(), [&](std::size_t const i){
+                if(carried.empty() || !carried[i]){
+                    this->evaluate_one(individuals[i], counters, bound);
+                }
+            });
+        }
+        last_evaluation = counters.snapshot(generation);
+        last_evaluation.culled = culled;
+        culled = 0;
+        last_evaluation.sample_rows = scoring_inputs().rows();
+        if(config::tune_elites != 0){
+            last_evaluation.tuned = tune_elites();
+        }
+        record(last_evaluation);
+        if(fresh_sample){
+            rescore_candidates();
+        }
+        if(elite_callback){
+            std::size_t const k = select_elites(elite_callback_count);
+            for(std::size_t i = 0; i < k; ++i){
+                elite_callback(individuals[order[i]]);
+            }
+        }
+    }
+
+    // With config::early_abort, the fitness an offspring must beat not to
+    // be rejected: that of the current individual at the fraction
+    // config::early_abort_quantile of those scored with a finite error,
+    // from the best; 1 takes the worst of them.
+    ValueType rejection_bound() const
+    {
+        if(!config::early_abort){
+            return individual_type::worst_fitness();
+        }
+        std::vector<ValueType> finite;
+        for(auto const& ind : individuals){
+            if(!ind.needs_evaluation() && ind.fitness < individual_type::worst_fitness()){
+                finite.push_back(ind.fitness);
+            }
+        }
+        if(finite.empty()){
+            return individual_type::worst_fitness();
+        }
+        double const q = std::min(std::max(config::early_abort_quantile, 0.0), 1.0);
+        auto const nth = finite.begin() + static_cast<std::size_t>(q * static_cast<double>(finite.size() - 1) + 0.5);
+        std::nth_element(finite.begin(), nth, finite.end());
+        return *nth;
+    }
+
+    // the population must not be empty
+    std::size_t best_index() const
+    {
+        return std::min_element(individuals.begin(), individuals.end(),
+                    [](individual_type const& lhs, individual_type const& rhs){
+                        return lhs.fitness < rhs.fitness;
+                    }) - individuals.begin();
+    }
+
+    // best (or, with worst, the worst) of config::tournament_size random picks
+    std::size_t tournament(bool const worst = false) const
+    {
+        std::size_t retval = random::uniform_index(individuals.size());
+        for(std::size_t i = 1; i < config::tournament_size; ++i){
+            std::size_t const challenger = random::uniform_index(individuals.size());
+            if(worst ? individuals[retval].fitness < individuals[challenger].fitness
+                     : individuals[challenger].fitness < individuals[retval].fitness){
+                retval = challenger;
+            }
+        }
+        return retval;
+    }
+
+    // Puts the indices of the n best individuals first in order, by partial
+    // selection, and returns n limited to the population size.
+    std::size_t select_elites(std::size_t n)
+    {
+        n = std::min(n, individuals.size());
+        order.resize(individuals.size());
+        std::iota(order.begin(), order.end(), 0);
+        if(n != 0 && n < order.size()){
+            std::nth_element(order.begin(), order.begin() + (n - 1), order.end(),
+                    [this](std::size_t const lhs, std::size_t const rhs){
+                        return individuals[lhs].fitness < individuals[rhs].fitness;
+                    });
+        }
+        return n;
+    }
+
+    void breed(individual_type &lhs, individual_type &rhs) const
+    {
+        if(random::bernoulli(config::crossover_rate)){
+            individual::crossover(lhs, rhs);
+        }
+        if(random::bernoulli(config::mutation_rate)){
+            individual::mutation(lhs);
+        }
+        if(random::bernoulli(config::mutation_rate)){
+            individual::mutation(rhs);
+        }
+    }
+
+    void generational_generation()
+    {
+        double* const selection_time = timing(current_metrics.selection_seconds);
+        double* const breeding_time = timing(current_metrics.breeding_seconds);
+        std::size_t elites;
+        {
+            metrics::scoped_timer timer(selection_time);
+            elites = select_elites(config::elite_count);
+            offspring.clear();
+            offspring.reserve(individuals.size());
+            for(std::size_t i = 0; i < elites; ++i){
+                offspring.push_back(individuals[order[i]]);
+            }
+        }
+        // with config::semantic_culling, offspring behaving like one kept
+        // already are dropped, unless config::breeding_attempts of them in
+        // a row were
+        bool const culling = config::semantic_culling && twins;
+        std::unordered_set<std::size_t> fingerprints;
+        std::size_t attempts = 0;
+        if(culling){
+            prepare_probes();
+            for(auto &ind : offspring){
+                novel(ind, fingerprints);
+            }
+        }
+        while(offspring.size() < individuals.size()){
+            std::size_t lhs_index, rhs_index;
+            {
+                metrics::scoped_timer timer(selection_time);
+                lhs_index = tournament();
+                rhs_index = tournament();
+            }
+            metrics::scoped_timer timer(breeding_time);
+            individual_type lhs = individuals[lhs_index];
+            individual_type rhs = individuals[rhs_index];
+            breed(lhs, rhs);
+            for(individual_type* child : {&lhs, &rhs}){
+                if(offspring.size() == individuals.size()){
+                    break;
+                }
+                if(culling && !novel(*child, fingerprints) && attempts < config::breeding_attempts){
+                    ++attempts;
+                    ++culled;
+                    continue;
+                }
+                attempts = 0;
+                offspring.push_back(std::move(*child));
+            }
+        }
+        individuals.swap(offspring);
+    }
+
+    void steady_state_generation()
+    {
+        double* const selection_time = timing(current_metrics.selection_seconds);
+        double* const breeding_time = timing(current_metrics.breeding_seconds);
+        double* const evaluation_time = timing(current_metrics.evaluation_seconds);
+        std::size_t const elites = select_elites(config::elite_count);
+        std::vector<bool> elite(individuals.size(), false);
+        for(std::size_t i = 0; i < elites; ++i){
+            elite[order[i]] = true;
+        }
+        if(elites + 2 > individuals.size()){
+            return;
+        }
+        prepare_input_ranges();
+        prepare_probes();
+
+        // slots not elite and not yet replaced in the current batch
+        std::vector<std::size_t> open;
+        // loser of a reverse tournament among the open slots, which it leaves
+        auto victim = [&]{
+            std::size_t pick = random::uniform_index(open.size());
+            for(std::size_t i = 1; i < config::tournament_size; ++i){
+                std::size_t const challenger = random::uniform_index(open.size());
+                if(individuals[open[pick]].fitness < individuals[open[challenger]].fitness){
+                    pick = challenger;
+                }
+            }
+            std::size_t const v = open[pick];
+            open[pick] = open.back();
+            open.pop_back();
+            return v;
+        };
+
+        evaluation_counters counters{};
+        std::vector<individual_type> bred;
+        std::vector<std::size_t> slots;
+        std::vector<ValueType> bounds;
+        std::size_t remaining = individuals.size() / 2;
+        while(remaining != 0){
+            open.clear();
+            for(std::size_t i = 0; i < individuals.size(); ++i){
+                if(!elite[i]){
+                    open.push_back(i);
+                }
+            }
+            std::size_t const pairs = std::min(std::min(remaining, std::max<std::size_t>(config::steady_state_batch, 1)),
+                                               open.size() / 2);
+            bred.clear();
+            slots.clear();
+            for(std::size_t step = 0; step < pairs; ++step){
+                std::size_t lhs_index, rhs_index;
+                {
+                    metrics::scoped_timer timer(selection_time);
+                    lhs_index = tournament();
+                    rhs_index = tournament();
+                    slots.push_back(victim());
+                    slots.push_back(victim());
+                }
+                bred.push_back(individuals[lhs_index]);
+                bred.push_back(individuals[rhs_index]);
+                metrics::scoped_timer timer(breeding_time);
+                breed(bred[bred.size() - 2], bred.back());
+            }
+            // with config::early_abort an offspring worse than the one it
+            // replaces is rejected; it still takes the place
+            bounds.clear();
+            for(std::size_t i = 0; i < slots.size(); ++i){
+                bounds.push_back(config::early_abort ? individuals[slots[i]].fitness : individual_type::worst_fitness());
+                individuals[slots[i]] = std::move(bred[i]);
+            }
+            metrics::scoped_timer timer(evaluation_time);
+            evaluate_slots(slots, bounds, counters);
+            remaining -= pairs;
+        }
+        last_evaluation = counters.snapshot(generation);
+        last_evaluation.sample_rows = scoring_inputs().rows();
+        record(last_evaluation);
+    }
+
+    // where a phase's time goes, null when metrics are not collected
+    double* timing(double &seconds) const
+    {
+        return metrics_callback ? &seconds : nullptr;
+    }
+
+    void record(evaluation_statistics const& stats)
+    {
+        if(metrics_callback){
+            current_metrics.evaluated += stats.evaluated;
+            current_metrics.table_hits += stats.table_hits;
+            current_metrics.rejected += stats.rejected;
+            current_metrics.duplicates += stats.duplicates;
+            current_metrics.culled += stats.culled;
+        }
+    }
+
+    void begin_metrics()
+    {
+        current_metrics = metrics::generation_metrics();
+        nodes_evaluated->reset();
+        metrics_memory_start = memory::thread_pools_statistics();
+        if(cache){
+            metrics_cache_start = cache->stats();
+        }
+    }
+
+    void end_metrics()
+    {
+        auto &m = current_metrics;
+        m.generation = generation;
+        m.nodes_evaluated = nodes_evaluated->sum();
+        std::size_t const lookups = m.evaluated + m.table_hits;
+        m.fitness_table_hit_rate = lookups == 0 ? 0.0 : static_cast<double>(m.table_hits) / lookups;
+        std::size_t const scored = lookups + m.duplicates;
+        m.duplicate_rate = scored == 0 ? 0.0 : static_cast<double>(m.table_hits + m.duplicates) / scored;
+        if(cache){
+            auto const now = cache->stats();
+            std::size_t const hits = now.hits - metrics_cache_start.hits;
+            std::size_t const misses = now.misses - metrics_cache_start.misses;
+            m.eval_cache_hit_rate = hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+        auto const memory_now = memory::thread_pools_statistics();
+        m.allocations = memory_now.allocations - metrics_memory_start.allocations;
+        m.node_bytes = memory_now.bytes_in_use;
+        std::size_t trees = 0;
+        for(auto const& ind : individuals){
+            for(auto const& t : ind.get_trees()){
+                m.size.add(metrics::histogram::log2_bucket(t.size()), t.size());
+                m.depth.add(t.depth(), t.depth());
+                ++trees;
+            }
+        }
+        m.size.finish(trees);
+        m.depth.finish(trees);
+        if(!individuals.empty()){
+            m.best_fitness = static_cast<double>(individuals[best_index()].fitness);
+        }
+        metrics_callback(m);
+    }
+
+    void next_generation_impl()
+    {
+        // generational mode evaluates the offspring as it breeds them;
+        // steady-state mode tunes the elites and draws samples here
+        if(config::steady_state){
+            evaluate();
+        }else{
+            evaluate_pending();
+        }
+        if(individuals.size() < 2){
+            ++generation;
+            return;
+        }
+        ValueType const bound = rejection_bound();
+        if(table){
+            tree::scoped_table<ValueType> use(*table);
+            config::steady_state ? steady_state_generation() : generational_generation();
+        }else{
+            config::steady_state ? steady_state_generation() : generational_generation();
+        }
+        ++generation;
+        if(!config::steady_state){
+            evaluate_all(bound);
+        }
+    }
+
     template<class Tuple, std::size_t... Idx1, std::size_t... Idx2>
     void set_training_data_impl(std::vector<Tuple> const& data, util::index_tuple<Idx1...>, util::index_tuple<Idx2...>)
     {
+        if(input_columns.is_view()){
+            input_columns = batch::columns<ValueType>(InputSize, 0);
+            output_columns = batch::columns<ValueType>(OutputSize, 0);
+        }
         for(auto const& d : data){
-            training_data.push_back({{std::get<Idx1>(d)...}, {std::get<Idx2>(d)...}});
+            input_columns.push_back(std::array<ValueType, InputSize>{{std::get<Idx1>(d)...}});
+            output_columns.push_back(std::array<ValueType, OutputSize>{{std::get<Idx2>(d)...}});
+        }
+    }
+
+    // makes every fitness stale, along with everything scored on the old data
+    void forget_fitness()
+    {
+        if(cache){
+            cache->clear();
+        }
+        if(fitnesses){
+            fitnesses->clear();
+        }
+        if(twins){
+            twins->clear();
+        }
+        for(auto &ind : individuals){
+            ind.invalidate_fitness();
         }
     }
 
+    void training_data_changed()
+    {
+        sample_order.clear();
+        sample_rows = 0;
+        sample_generation = no_sample;
+        best_of_run.reset();
+        input_ranges.clear();
+        probe_inputs = batch::columns<ValueType>();
+        forget_fitness();
+    }
+
 public:
-    population() : individuals(config::population_size){}
+    explicit population(std::size_t const size = config::population_size)
+        : input_columns(InputSize, 0), output_columns(OutputSize, 0), individuals()
+    {
+        if(config::eval_cache_bytes != 0){
+            cache = std::make_shared<batch::subtree_cache<ValueType>>(config::eval_cache_bytes);
+        }
+        if(config::fitness_table_size != 0){
+            fitnesses = std::make_shared<memo_type>(config::fitness_table_size);
+        }
+        if(config::semantic_probe_rows != 0){
+            twins = std::make_shared<fitness_table<ValueType>>(std::max<std::size_t>(config::fitness_table_size, 1));
+        }
+        if(config::hash_consing){
+            table = std::make_shared<tree::hashcons_table<ValueType>>();
+            tree::scoped_table<ValueType> use(*table);
+            individuals.resize(size);
+        }else{
+            individuals.resize(size);
+        }
+    }
 
     template<class Tuple>
     void set_training_data(std::vector<Tuple> const& data)
     {
         set_training_data_impl(data, util::idx_range<0, InputSize>(), util::idx_range<InputSize, InputSize+OutputSize>());
+        training_data_changed();
+    }
+
+    // Uses columns as the training data, replacing what was there. Views,
+    // e.g. from dataset::mapped::columns(), are used without copying.
+    void set_training_columns(batch::columns<ValueType> inputs, batch::columns<ValueType> outputs)
+    {
+        if(inputs.size() != InputSize || outputs.size() != OutputSize){
+            throw("gene::population::set_training_columns: wrong number of columns.");
+        }
+        if(inputs.rows() != outputs.rows()){
+            throw("gene::population::set_training_columns: inputs and outputs differ in rows.");
+        }
+        input_columns = std::move(inputs);
+        output_columns = std::move(outputs);
+        training_data_changed();
+    }
+
+    // training inputs and outputs in structure-of-arrays form
+    batch::columns<ValueType> const& training_inputs() const
+    {
+        return input_columns;
+    }
+
+    batch::columns<ValueType> const& training_outputs() const
+    {
+        return output_columns;
+    }
+
+    // pool used by evaluate(), shared between populations if wanted
+    void set_thread_pool(std::shared_ptr<thread_pool> p)
+    {
+        pool = std::move(p);
+    }
+
+    // evaluate on the calling thread only, e.g. when each population
+    // already has a thread of its own (see island_model)
+    void set_serial_evaluation(bool const enable)
+    {
+        serial = enable;
+    }
+
+    // Computes the fitness of every individual on the thread pool.
+    // Each individual is scored by one task only, so the results do not
+    // depend on the number of threads. Individuals unchanged since their
+    // last evaluation are skipped, and duplicates of already evaluated ones
+    // take their fitness from the fitness table. With
+    // config::simplify_before_evaluation, the individuals to evaluate are
+    // simplified first, which also brings more of them to a common form.
+    //
+    // Mini-batch mode (config::minibatch_rows): each generation scores on
+    // its own subsample of the training data, taken from a shuffled order
+    // of the rows without repeats until every row has been used, so the
+    // cost per generation follows the subsample size, not the data size.
+    // The fitness table and subtree cache are emptied with every new
+    // subsample. The best few individuals of each subsample are then scored
+    // on all rows (see most_suitable_individual()), and the subsample
+    // doubles when those two scores often rank them differently, or
+    // shrinks back towards config::minibatch_rows when they seldom do.
+    //
+    // With config::tune_elites, the constants of that many of the best
+    // individuals are then fitted by Levenberg-Marquardt (see
+    // autodiff::fit_constants), once for each individual, and they are
+    // scored with the fitted constants.
+    //
+    // Static analysis (see range_analysis.hpp) bounds each tree over the
+    // box spanned by the training inputs, computed once per data set. With
+    // config::interval_folding, subtrees constant over that box are folded
+    // before scoring. With config::interval_rejection, trees sure to be
+    // undefined there (e.g. sqrt(-1 - abs(x0)) or log(x0 - x0)) get the
+    // worst fitness without being scored, and with
+    // config::interval_rejection_strict so do those that may be undefined
+    // on part of it. The analysis is conservative: the box holds inputs
+    // the data may lack, and bounds may be wider than the true range.
+    //
+    // Semantic deduplication (config::semantic_probe_rows): individuals
+    // are fingerprinted by their outputs on that many evenly spaced
+    // training rows (see individual::fingerprint), and one whose
+    // fingerprint was scored already, in this evaluation or an earlier
+    // one on the same data, takes that fitness instead of being scored;
+    // twins of one rejected by config::early_abort or
+    // config::interval_rejection are scored themselves.
+    // Behaviour off the probe rows is not compared, so a twin may be
+    // credited with a fitness it would not reach. With
+    // config::semantic_culling, generational breeding also drops offspring
+    // whose fingerprint is already in the next generation. evaluation_stats()
+    // and the metrics report how many there were.
+    void evaluate()
+    {
+        evaluate_all(individual_type::worst_fitness());
+    }
+
+    // evaluate(), unless no individual needs it: the statistics, tuning
+    // and elite callback of the last evaluation then stay as they were
+    void evaluate_pending()
+    {
+        if(std::any_of(individuals.begin(), individuals.end(),
+                       [](individual_type const& ind){ return ind.needs_evaluation(); })){
+            evaluate();
+        }
+    }
+
+    // Breeds the next generation, after evaluating the current one.
+    //
+    // Generational mode: the config::elite_count best individuals are kept,
+    // the rest are offspring of tournament winners, built into a buffer
+    // that is reused from one generation to the next.
+    //
+    // Steady-state mode (config::steady_state): pairs of offspring replace
+    // losers of reverse tournaments in place, in batches of
+    // config::steady_state_batch pairs that are scored in parallel and can
+    // be selected by the following batches; a generation is size()
+    // offspring. The elites of the generation start are never replaced,
+    // and no slot is replaced twice in a batch.
+    //
+    // Offspring are crossed over with probability config::crossover_rate
+    // and then each mutated with probability config::mutation_rate; those
+    // that are neither are plain copies and keep their fitness.
+    //
+    // With config::early_abort, the evaluation of an offspring stops once
+    // it is sure to be worse than the worst individual of the previous
+    // generation, or in steady-state mode than the one it replaces. It is
+    // then rejected (see individual::calc_fitness_bounded) and its fitness
+    // is only a lower bound, but one above that bound, so selection still
+    // ranks it behind every individual that beat the bound.
+    void next_generation()
+    {
+        if(metrics_callback){
+            begin_metrics();
+        }
+        {
+            metrics::scoped_timer timer(timing(current_metrics.total_seconds));
+            next_generation_impl();
+        }
+        if(metrics_callback){
+            end_metrics();
+        }
+    }
+
+    // Calls f at the end of every next_generation() with what it did, on
+    // the calling thread; an empty f stops the collection, which then
+    // costs next to nothing. metrics::jsonl_writer writes the metrics as
+    // JSON lines. Allocations and node bytes are those of every thread's
+    // node pool, so they cover other populations of the process too.
+    void set_metrics_callback(std::function<void(metrics::generation_metrics const&)> f)
+    {
+        metrics_callback = std::move(f);
+        if(metrics_callback){
+            if(!nodes_evaluated){
+                nodes_evaluated = std::make_shared<metrics::sharded_counter>();
+            }
+        }else{
+            nodes_evaluated.reset();
+        }
+    }
+
+    // Calls f on each of the n best individuals after every evaluation of
+    // the whole population, on the calling thread; f must leave their trees
+    // and fitness as they are. jit::attach uses it to give elites native
+    // code. An empty f stops the calls.
+    void set_elite_callback(std::size_t const n, std::function<void(individual_type &)> f)
+    {
+        elite_callback_count = n;
+        elite_callback = std::move(f);
+    }
+
+    // fitness of the best individual, evaluating if needed; the worst
+    // fitness for an empty population
+    ValueType fitness()
+    {
+        if(individuals.empty() && !(sampling() && best_of_run)){
+            return individual_type::worst_fitness();
+        }
+        return most_suitable_individual().fitness;
+    }
+
+    // In mini-batch mode, the best individual found so far by its score on
+    // all rows, which may no longer be in the population.
+    individual_type const& most_suitable_individual()
+    {
+        evaluate_pending();
+        if(sampling() && best_of_run){
+            return *best_of_run;
+        }
+        if(individuals.empty()){
+            throw("gene::population::most_suitable_individual: empty population.");
+        }
+        return individuals[best_index()];
+    }
+
+    // copies of the n best individuals, in no particular order
+    std::vector<individual_type> best_individuals(std::size_t n)
+    {
+        evaluate_pending();
+        n = select_elites(n);
+        std::vector<individual_type> retval;
+        retval.reserve(n);
+        for(std::size_t i = 0; i < n; ++i){
+            retval.push_back(individuals[order[i]]);
+        }
+        return retval;
+    }
+
+    // Moves incoming individuals into the places of the worst ones, keeping
+    // their fitness; they must have been scored on the same training data.
+    // With sampling their fitness comes from another subsample, so they are
+    // scored again with the next evaluation.
+    void replace_worst(std::vector<individual_type> &incoming)
+    {
+        std::size_t const n = std::min(incoming.size(), individuals.size());
+        if(n == 0){
+            return;
+        }
+        evaluate_pending();
+        order.resize(individuals.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::nth_element(order.begin(), order.begin() + (n - 1), order.end(),
+                [this](std::size_t const lhs, std::size_t const rhs){
+                    return individuals[rhs].fitness < individuals[lhs].fitness;
+                });
+        for(std::size_t i = 0; i < n; ++i){
+            individuals[order[i]] = std::move(incoming[i]);
+            if(sampling()){
+                individuals[order[i]].invalidate_fitness();
+            }
+        }
+    }
+
+    evaluation_statistics const& evaluation_stats() const
+    {
+        return last_evaluation;
+    }
+
+    // memoized fitnesses, null if config::fitness_table_size was 0
+    std::shared_ptr<memo_type> const& fitness_memo() const
+    {
+        return fitnesses;
+    }
+
+    // table of shared subtrees, null unless config::hash_consing was set
+    std::shared_ptr<tree::hashcons_table<ValueType>> const& node_table() const
+    {
+        return table;
+    }
+
+    // subtree result cache used by evaluate(), null unless
+    // config::eval_cache_bytes was set
+    std::shared_ptr<batch::subtree_cache<ValueType>> const& eval_cache() const
+    {
+        return cache;
+    }
+
+    std::size_t size() const
+    {
+        return individuals.size();
+    }
+
+    individual_type const& operator[](std::size_t const i) const
+    {
+        return individuals[i];
     }
 
     std::size_t current_generation() const
     {
         return generation;
     }
+
+    // Replaces the individuals and the generation counter, e.g. with those
+    // of a checkpoint (see serialize.hpp). Fitness values are kept.
+    void restore(std::vector<individual_type> individuals_, std::size_t const generation_)
+    {
+        individuals = std::move(individuals_);
+        generation = generation_;
+        sample_generation = no_sample;
+    }
 };
 
 } // namespace gene
@@ -0,0 +1,413 @@
+#if !defined GENE_RANDOM_HPP_INCLUDED
+#define      GENE_RANDOM_HPP_INCLUDED
+
+#include <random>
+#include <limits>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace gene {
+
+namespace random {
+
+    namespace impl {
+
+        inline std::uint64_t rotl(std::uint64_t const x, int const k)
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+
+        inline std::uint64_t splitmix64(std::uint64_t &x)
+        {
+            std::uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        inline void mulhilo32(std::uint32_t const a, std::uint32_t const b, std::uint32_t &hi, std::uint32_t &lo)
+        {
+            std::uint64_t const p = static_cast<std::uint64_t>(a) * b;
+            hi = static_cast<std::uint32_t>(p >> 32);
+            lo = static_cast<std::uint32_t>(p);
+        }
+
+    } // namespace impl
+
+    // Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+    // The output is a pure function of (key, counter): any position of any
+    // stream is reachable in O(1), which makes it suitable for keyed streams.
+    class philox4x32{
+    public:
+        typedef std::uint64_t result_type;
+        typedef std::array<std::uint32_t, 4> counter_type;
+        typedef std::array<std::uint32_t, 2> key_type;
+
+    private:
+        counter_type counter;
+        key_type key;
+        counter_type block;
+        std::size_t used;
+
+        void generate()
+        {
+            counter_type c = counter;
+            key_type k = key;
+            for(int round = 0; round < 10; ++round){
+                std::uint32_t hi0, lo0, hi1, lo1;
+                impl::mulhilo32(0xD2511F53u, c[0], hi0, lo0);
+                impl::mulhilo32(0xCD9E8D57u, c[2], hi1, lo1);
+                c = {{ hi1 ^ c[1] ^ k[0], lo1, hi0 ^ c[3] ^ k[1], lo0 }};
+                k[0] += 0x9E3779B9u;
+                k[1] += 0xBB67AE85u;
+            }
+            block = c;
+            used = 0;
+            // the low 64 bits of the counter count blocks, the high 64 bits select the stream
+            if(++counter[0] == 0){
+                ++counter[1];
+            }
+        }
+
+    public:
+        explicit philox4x32(std::uint64_t const seed = 0, std::uint64_t const stream_id = 0)
+            : counter{{ 0, 0, static_cast<std::uint32_t>(stream_id), static_cast<std::uint32_t>(stream_id >> 32) }},
+              key{{ static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) }},
+              block(), used(4)
+        {}
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+        result_type operator()()
+        {
+            if(used >= 4){
+                generate();
+            }
+            std::uint64_t const lo = block[used++];
+            std::uint64_t const hi = block[used++];
+            return lo | (hi << 32);
+        }
+
+        // skips n outputs
+        void discard(std::uint64_t n)
+        {
+            std::uint64_t const position = (static_cast<std::uint64_t>(counter[1]) << 32 | counter[0]) * 2 - (4 - used) / 2 + n;
+            std::uint64_t const blocks = position / 2;
+            counter[0] = static_cast<std::uint32_t>(blocks);
+            counter[1] = static_cast<std::uint32_t>(blocks >> 32);
+            used = 4;
+            if(position % 2 != 0){
+                generate();
+                used = 2;
+            }
+        }
+
+        static philox4x32 stream(std::uint64_t const seed, std::uint64_t const stream_id)
+        {
+            return philox4x32(seed, stream_id);
+        }
+
+        std::array<std::uint64_t, 4> state() const
+        {
+            return {{ static_cast<std::uint64_t>(counter[1]) << 32 | counter[0],
+                      static_cast<std::uint64_t>(counter[3]) << 32 | counter[2],
+                      static_cast<std::uint64_t>(key[1]) << 32 | key[0],
+                      used }};
+        }
+
+        void set_state(std::array<std::uint64_t, 4> const& s)
+        {
+            counter = {{ static_cast<std::uint32_t>(s[0]), static_cast<std::uint32_t>(s[0] >> 32),
+                         static_cast<std::uint32_t>(s[1]), static_cast<std::uint32_t>(s[1] >> 32) }};
+            key = {{ static_cast<std::uint32_t>(s[2]), static_cast<std::uint32_t>(s[2] >> 32) }};
+            used = 4;
+            if(s[3] < 4){
+                // regenerate the block the saved engine was reading from
+                std::uint64_t const previous = s[0] - 1;
+                counter[0] = static_cast<std::uint32_t>(previous);
+                counter[1] = static_cast<std::uint32_t>(previous >> 32);
+                generate();
+                used = static_cast<std::size_t>(s[3]);
+            }
+        }
+    };
+
+    // xoshiro256** (Blackman and Vigna). Fast, 2^256-1 period, and jump()
+    // advances by 2^128 outputs, which splits one seed into non-overlapping streams.
+    class xoshiro256ss{
+    public:
+        typedef std::uint64_t result_type;
+
+    private:
+        std::array<std::uint64_t, 4> s;
+
+        void jump_by(std::array<std::uint64_t, 4> const& polynomial)
+        {
+            std::array<std::uint64_t, 4> t = {{ 0, 0, 0, 0 }};
+            for(auto const word : polynomial){
+                for(int b = 0; b < 64; ++b){
+                    if(word & (std::uint64_t(1) << b)){
+                        for(std::size_t i = 0; i < 4; ++i){
+                            t[i] ^= s[i];
+                        }
+                    }
+                    (*this)();
+                }
+            }
+            s = t;
+        }
+
+    public:
+        explicit xoshiro256ss(std::uint64_t seed = 0)
+        {
+            for(auto &word : s){
+                word = impl::splitmix64(seed);
+            }
+        }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+        result_type operator()()
+        {
+            std::uint64_t const result = impl::rotl(s[1] * 5, 7) * 9;
+            std::uint64_t const t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = impl::rotl(s[3], 45);
+            return result;
+        }
+
+        void discard(std::uint64_t n)
+        {
+            while(n--){
+                (*this)();
+            }
+        }
+
+        // equivalent to 2^128 calls of operator()
+        void jump()
+        {
+            jump_by({{ 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL }});
+        }
+
+        // equivalent to 2^192 calls of operator()
+        void long_jump()
+        {
+            jump_by({{ 0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL }});
+        }
+
+        // Stream stream_id of seed. The state is drawn from Philox keyed by
+        // seed at counter stream_id, so streams are independent of each other
+        // and of the order in which they are created.
+        static xoshiro256ss stream(std::uint64_t const seed, std::uint64_t const stream_id)
+        {
+            philox4x32 keyed(seed, stream_id);
+            xoshiro256ss retval;
+            for(auto &word : retval.s){
+                word = keyed();
+            }
+            if(retval.s[0] == 0 && retval.s[1] == 0 && retval.s[2] == 0 && retval.s[3] == 0){
+                retval.s[0] = 1;
+            }
+            return retval;
+        }
+
+        std::array<std::uint64_t, 4> state() const
+        {
+            return s;
+        }
+
+        void set_state(std::array<std::uint64_t, 4> const& s_)
+        {
+            s = s_;
+        }
+    };
+
+#if defined GENE_RANDOM_ENGINE
+    typedef GENE_RANDOM_ENGINE engine_type;
+#else
+    typedef xoshiro256ss engine_type;
+#endif
+
+    // Seed every stream derives from. Defaults to a nondeterministic value;
+    // call seed() before building populations for reproducible runs.
+    inline std::uint64_t& global_seed()
+    {
+        static std::uint64_t value = (static_cast<std::uint64_t>(std::random_device{}()) << 32) ^ std::random_device{}();
+        return value;
+    }
+
+    // independent stream of the global seed, e.g. one per individual or task
+    inline engine_type stream(std::uint64_t const stream_id)
+    {
+        return engine_type::stream(global_seed(), stream_id);
+    }
+
+    namespace impl {
+
+        // stream ids from the top of the id space are reserved for the
+        // per-thread default engines, so they never collide with user streams
+        inline std::uint64_t next_thread_stream()
+        {
+            static std::atomic<std::uint64_t> count(0);
+            return std::numeric_limits<std::uint64_t>::max() - count++;
+        }
+
+        inline std::uint64_t thread_stream_id()
+        {
+            static thread_local std::uint64_t const id = next_thread_stream();
+            return id;
+        }
+
+        inline engine_type& thread_default_engine()
+        {
+            static thread_local engine_type e = stream(thread_stream_id());
+            return e;
+        }
+
+        inline engine_type*& current_engine()
+        {
+            static thread_local engine_type* e = nullptr;
+            return e;
+        }
+
+    } // namespace impl
+
+    // The engine used by this thread: the innermost scoped_engine, or a
+    // per-thread default stream of the global seed.
+    inline engine_type& engine()
+    {
+        auto const e = impl::current_engine();
+        return e ? *e : impl::thread_default_engine();
+    }
+
+    // Resets the global seed and the calling thread's default engine.
+    inline void seed(std::uint64_t const value)
+    {
+        global_seed() = value;
+        impl::thread_default_engine() = stream(impl::thread_stream_id());
+    }
+
+    // Makes engine() return e on this thread for the lifetime of the guard.
+    // Giving each unit of work its own stream(id) makes a parallel run
+    // reproducible whatever the number of threads.
+    class scoped_engine{
+    private:
+        engine_type* previous;
+
+    public:
+        explicit scoped_engine(engine_type &e) : previous(impl::current_engine())
+        {
+            impl::current_engine() = &e;
+        }
+
+        scoped_engine(scoped_engine const&) = delete;
+        scoped_engine& operator=(scoped_engine const&) = delete;
+
+        ~scoped_engine()
+        {
+            impl::current_engine() = previous;
+        }
+    };
+
+    // Draws without distribution objects. Engines must produce 64 random bits.
+
+    // uniform in [0, 1)
+    template<class Engine>
+    inline double canonical(Engine &e)
+    {
+        return (e() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // uniform in [a, b)
+    template<class Engine>
+    inline double uniform_real(Engine &e, double const a, double const b)
+    {
+        return a + (b - a) * canonical(e);
+    }
+
+    // uniform in [0, n), n > 0 (Lemire's multiply-and-reject method)
+    template<class Engine>
+    inline std::uint64_t uniform_index(Engine &e, std::uint64_t const n)
+    {
+#if defined __SIZEOF_INT128__
+        unsigned __int128 m = static_cast<unsigned __int128>(e()) * n;
+        auto low = static_cast<std::uint64_t>(m);
+        if(low < n){
+            std::uint64_t const threshold = (0 - n) % n;
+            while(low < threshold){
+                m = static_cast<unsigned __int128>(e()) * n;
+                low = static_cast<std::uint64_t>(m);
+            }
+        }
+        return static_cast<std::uint64_t>(m >> 64);
+#else
+        std::uint64_t const limit = std::numeric_limits<std::uint64_t>::max() - std::numeric_limits<std::uint64_t>::max() % n;
+        std::uint64_t x;
+        do{
+            x = e();
+        }while(x >= limit);
+        return x % n;
+#endif
+    }
+
+    // uniform in [a, b]
+    template<class Engine>
+    inline std::int64_t uniform_int(Engine &e, std::int64_t const a, std::int64_t const b)
+    {
+        return a + static_cast<std::int64_t>(uniform_index(e, static_cast<std::uint64_t>(b - a) + 1));
+    }
+
+    template<class Engine>
+    inline bool bernoulli(Engine &e, double const p)
+    {
+        return canonical(e) < p;
+    }
+
+    inline double canonical() { return canonical(engine()); }
+    inline double uniform_real(double const a, double const b) { return uniform_real(engine(), a, b); }
+    inline std::uint64_t uniform_index(std::uint64_t const n) { return uniform_index(engine(), n); }
+    inline std::int64_t uniform_int(std::int64_t const a, std::int64_t const b) { return uniform_int(engine(), a, b); }
+    inline bool bernoulli(double const p) { return bernoulli(engine(), p); }
+
+    // Batched draws, n values at a time.
+
+    template<class Engine, class Real>
+    inline void uniform_real(Engine &e, Real* out, std::size_t const n, double const a, double const b)
+    {
+        for(std::size_t i = 0; i < n; ++i){
+            out[i] = static_cast<Real>(uniform_real(e, a, b));
+        }
+    }
+
+    template<class Engine>
+    inline void bernoulli(Engine &e, bool* out, std::size_t const n, double const p)
+    {
+        // compare 64-bit integers against a fixed threshold instead of converting each draw
+        std::uint64_t const threshold = p >= 1.0 ? std::numeric_limits<std::uint64_t>::max()
+                                      : static_cast<std::uint64_t>(p * 18446744073709551616.0);
+        for(std::size_t i = 0; i < n; ++i){
+            out[i] = p >= 1.0 || e() < threshold;
+        }
+    }
+
+    template<class Engine, class Index>
+    inline void uniform_index(Engine &e, Index* out, std::size_t const n, std::uint64_t const bound)
+    {
+        for(std::size_t i = 0; i < n; ++i){
+            out[i] = static_cast<Index>(uniform_index(e, bound));
+        }
+    }
+
+} // namespace random
+
+} // namespace gene
+
+#endif    // GENE_RANDOM_HPP_INCLUDED
@@ -2,6 +2,7 @@
 #define      GENE_RANDOM_TERM_HPP_INCLUDED
 
 #include "config.hpp"
+#include "random.hpp"
 
 #include <array>
 #include <type_traits>
@@ -40,10 +41,8 @@ namespace random_term {
                                                                10000,
                                                               100000,
                                                              1000000  }};
-            std::uniform_real_distribution<double> sig_dst(1.0, 10.0);
-            double sig = sig_dst(config::random_engine);
-            std::uniform_int_distribution<std::size_t> idx_dst(0, 13);
-            std::size_t idx = idx_dst(config::random_engine);
+            double sig = random::uniform_real(1.0, 10.0);
+            std::size_t idx = random::uniform_index(cardinals.size());
             return static_cast<Term>(sig * cardinals[idx]);
         }
     };
@@ -66,10 +65,8 @@ namespace random_term {
                                                                      10000,
                                                                     100000,
                                                                    1000000  }};
-            std::uniform_real_distribution<double> sig_dst(1.0, 10.0);
-            double sig = sig_dst(config::random_engine);
-            std::uniform_int_distribution<std::size_t> idx_dst(0, 6);
-            std::size_t idx = idx_dst(config::random_engine);
+            double sig = random::uniform_real(1.0, 10.0);
+            std::size_t idx = random::uniform_index(cardinals.size());
             return static_cast<Term>(sig * cardinals[idx]);
         }
     };
@@ -79,13 +76,11 @@ namespace random_term {
     public:
         static std::string generate_term()
         {
-            std::uniform_int_distribution<char> char_dst(0x20, 0x7e);
-            std::uniform_int_distribution<std::size_t> size_dst(1, 1000);
-            std::size_t const size = size_dst(config::random_engine);
+            std::size_t const size = random::uniform_int(1, 1000);
             std::string retval;
 
             for(std::size_t i = 0; i < size; ++i){
-                retval += char_dst(config::random_engine);
+                retval += static_cast<char>(random::uniform_int(0x20, 0x7e));
             }
 
             return retval;
@@ -0,0 +1,164 @@
+#if !defined GENE_RANGE_ANALYSIS_HPP_INCLUDED
+#define      GENE_RANGE_ANALYSIS_HPP_INCLUDED
+
+#include "interval.hpp"
+#include "node.hpp"
+#include "operators.hpp"
+#include "hashcons.hpp"
+#include "tree.hpp"
+#include "simplify.hpp"
+#include "batch.hpp"
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+
+#include <boost/variant.hpp>
+
+namespace gene {
+
+namespace intervals {
+
+    // smallest box holding every row of inputs, one interval per column;
+    // a column holding inf or NaN may be undefined
+    template<class ValueType>
+    std::vector<interval<ValueType>> of_columns(batch::columns<ValueType> const& inputs)
+    {
+        ValueType const inf = std::numeric_limits<ValueType>::infinity();
+        std::vector<interval<ValueType>> retval;
+        for(std::size_t c = 0; c < inputs.size(); ++c){
+            ValueType const* column = inputs.column(c);
+            auto r = interval<ValueType>::of(inf, -inf);
+            for(std::size_t i = 0; i < inputs.rows(); ++i){
+                ValueType const v = column[i];
+                if(std::isfinite(v)){
+                    r.lo = std::min(r.lo, v);
+                    r.hi = std::max(r.hi, v);
+                }else{
+                    r.maybe_undefined = true;
+                }
+            }
+            retval.push_back(r.lo <= r.hi ? r : interval<ValueType>::failed());
+        }
+        return retval;
+    }
+
+} // namespace intervals
+
+namespace tree {
+
+    namespace impl {
+
+        template<class Primitives, class ValueType>
+        intervals::interval<ValueType> range_impl(std::shared_ptr<node<ValueType>> const& n,
+                                                  std::vector<intervals::interval<ValueType>> const& inputs)
+        {
+            typedef intervals::interval<ValueType> interval_type;
+            switch(n->which()){
+            case constant_value:
+                return interval_type::point(boost::get<ValueType>(*n));
+            case variable_value:
+                {
+                    auto const v = boost::get<Variable>(*n);
+                    return v < inputs.size() ? inputs[v] : interval_type::whole();
+                }
+            default:
+                {
+                    auto const& k = boost::get<knot<ValueType>>(*n);
+                    interval_type args[Primitives::max_arity];
+                    ValueType values[Primitives::max_arity];
+                    bool points = true;
+                    for(std::size_t i = 0; i < k.children.size(); ++i){
+                        args[i] = range_impl<Primitives>(k.children[i], inputs);
+                        values[i] = args[i].lo;
+                        points = points && args[i].is_point();
+                    }
+                    // the evaluator's own arithmetic, so that folding is exact
+                    return points ? interval_type::point(Primitives::template apply<ValueType>(k.op, values))
+                                  : Primitives::range(k.op, args);
+                }
+            }
+        }
+
+        // Replaces knots whose range is a single value with that constant.
+        // Unchanged subtrees are returned as they are, so they stay shared.
+        template<class Primitives, class ValueType>
+        std::shared_ptr<node<ValueType>> fold_impl(std::shared_ptr<node<ValueType>> const& n,
+                                                   std::vector<intervals::interval<ValueType>> const& inputs,
+                                                   intervals::interval<ValueType> &range)
+        {
+            typedef intervals::interval<ValueType> interval_type;
+            if(n->which() != knot_value){
+                range = range_impl<Primitives>(n, inputs);
+                return n;
+            }
+
+            auto const& original = boost::get<knot<ValueType>>(*n);
+            auto children = original.children;
+            interval_type args[Primitives::max_arity];
+            ValueType values[Primitives::max_arity];
+            bool changed = false;
+            bool points = true;
+            for(std::size_t i = 0; i < children.size(); ++i){
+                auto folded = fold_impl<Primitives>(children[i], inputs, args[i]);
+                changed = changed || folded != children[i];
+                children[i] = std::move(folded);
+                values[i] = args[i].lo;
+                points = points && args[i].is_point();
+            }
+            range = points ? interval_type::point(Primitives::template apply<ValueType>(original.op, values))
+                           : Primitives::range(original.op, args);
+
+            if(range.is_point()){
+                return make_node<ValueType>(range.lo);
+            }
+            if(!changed){
+                return n;
+            }
+            knot<ValueType> knot_node(original.op, original.arity);
+            knot_node.children = std::move(children);
+            return make_node<ValueType>(std::move(knot_node));
+        }
+
+    } // namespace impl
+
+    // Values t takes while each variable i stays in inputs[i], found by
+    // interval arithmetic without evaluating t (see interval.hpp). The
+    // range holds every value t takes there, up to rounding, and may be
+    // wider. Variables without a range are unbounded.
+    template<class ValueType, class RandomTermGen, class Primitives>
+    intervals::interval<ValueType> range(tree<ValueType, RandomTermGen, Primitives> const& t,
+                                         std::vector<intervals::interval<ValueType>> const& inputs)
+    {
+        return impl::range_impl<Primitives>(t.root_node(), inputs);
+    }
+
+    // Replaces every subtree that takes a single, finite value while the
+    // variables stay in inputs with that constant, e.g. sqrt( abs( x0 ) )
+    // * 0, or a conditional whose condition is decided over the inputs and
+    // whose branch is constant. Returns the number of nodes removed; t
+    // gives the same values on inputs in the box, but for the sign of a
+    // zero (x0 * 0 becomes 0, as with tree::simplify).
+    template<class ValueType, class RandomTermGen, class Primitives>
+    std::size_t fold_invariants(tree<ValueType, RandomTermGen, Primitives> &t,
+                                std::vector<intervals::interval<ValueType>> const& inputs)
+    {
+        auto const root = t.root_node();
+        intervals::interval<ValueType> r;
+        auto const folded = impl::fold_impl<Primitives>(root, inputs, r);
+        if(folded == root){
+            return 0;
+        }
+        std::size_t const before = node_size(*root);
+        t = tree<ValueType, RandomTermGen, Primitives>(folded);
+        return before - node_size(*folded);
+    }
+
+} // namespace tree
+
+} // namespace gene
+
+#endif    // GENE_RANGE_ANALYSIS_HPP_INCLUDED
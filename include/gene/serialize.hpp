@@ -0,0 +1,492 @@
+#if !defined GENE_SERIALIZE_HPP_INCLUDED
+#define      GENE_SERIALIZE_HPP_INCLUDED
+
+#include "config.hpp"
+#include "random.hpp"
+#include "node.hpp"
+#include "operators.hpp"
+#include "hashcons.hpp"
+#include "tree.hpp"
+#include "flat_tree.hpp"
+#include "individual.hpp"
+#include "population.hpp"
+#include "thread_pool.hpp"
+#include "mapped_file.hpp"
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <iterator>
+#include <future>
+#include <type_traits>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+// Binary checkpoint format, in the byte order of the writing machine:
+//
+//   header      "GENE", u32 byte order mark 0x01020304, u32 format version,
+//               u32 record kind, u32 sizeof(ValueType), u32 input size,
+//               u32 output size (both 0 for a lone tree)
+//   tree        u64 node count, flat_node[count] as (u32 kind, u32 payload)
+//               in prefix order, u64 constant count, ValueType[count]
+//   individual  u32 tree count, tree[count], ValueType fitness,
+//               u8 1 if the fitness is stale or only a lower bound
+//   population  u64 generation, u64 global seed, u64[4] state of the
+//               saving thread's random engine, u64 individual count,
+//               individual[count], then an index of u64 offsets of every
+//               individual from the start of the file and, last, the u64
+//               offset of that index
+//
+// Records of a lone tree or individual are a header followed by the body.
+// The index lets a memory-mapped population be decoded in parallel.
+
+namespace gene {
+
+namespace serialize {
+
+    constexpr std::uint32_t format_version = 1;
+
+    enum struct record : std::uint32_t{
+        tree = 1, individual = 2, population = 3
+    };
+
+    namespace impl {
+
+        constexpr char magic[4] = {'G', 'E', 'N', 'E'};
+        constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+        class writer{
+        private:
+            std::ostream &out;
+            std::uint64_t written;
+
+        public:
+            explicit writer(std::ostream &out_) : out(out_), written(0) {}
+
+            template<class T>
+            void put(T const& value)
+            {
+                put_array(&value, 1);
+            }
+
+            template<class T>
+            void put_array(T const* const values, std::size_t const n)
+            {
+                static_assert(std::is_trivially_copyable<T>::value, "gene::serialize: only trivially copyable values are written raw");
+                out.write(reinterpret_cast<char const*>(values), n * sizeof(T));
+                written += n * sizeof(T);
+            }
+
+            std::uint64_t position() const
+            {
+                return written;
+            }
+
+            void check() const
+            {
+                if(!out){
+                    throw("gene::serialize::writer: write failed.");
+                }
+            }
+        };
+
+        // bounds-checked cursor over bytes already in memory
+        class reader{
+        private:
+            char const* begin;
+            char const* cursor;
+            char const* end;
+
+        public:
+            reader(char const* const data, std::size_t const size)
+                : begin(data), cursor(data), end(data + size)
+            {}
+
+            template<class T>
+            T get()
+            {
+                T retval;
+                get_array(&retval, 1);
+                return retval;
+            }
+
+            template<class T>
+            void get_array(T* const values, std::size_t const n)
+            {
+                static_assert(std::is_trivially_copyable<T>::value, "gene::serialize: only trivially copyable values are read raw");
+                if(n > static_cast<std::size_t>(end - cursor) / sizeof(T)){
+                    throw("gene::serialize::reader: unexpected end of data.");
+                }
+                std::memcpy(values, cursor, n * sizeof(T));
+                cursor += n * sizeof(T);
+            }
+
+            void seek(std::uint64_t const offset)
+            {
+                if(offset > static_cast<std::uint64_t>(end - begin)){
+                    throw("gene::serialize::reader: offset out of range.");
+                }
+                cursor = begin + offset;
+            }
+
+            std::size_t size() const
+            {
+                return end - begin;
+            }
+        };
+
+        template<class ValueType>
+        void write_header(writer &w, record const kind, std::uint32_t const input_size, std::uint32_t const output_size)
+        {
+            w.put_array(magic, 4);
+            w.put(byte_order_mark);
+            w.put(format_version);
+            w.put(static_cast<std::uint32_t>(kind));
+            w.put(static_cast<std::uint32_t>(sizeof(ValueType)));
+            w.put(input_size);
+            w.put(output_size);
+        }
+
+        template<class ValueType>
+        void read_header(reader &r, record const kind, std::uint32_t const input_size, std::uint32_t const output_size)
+        {
+            char m[4];
+            r.get_array(m, 4);
+            if(std::memcmp(m, magic, 4) != 0){
+                throw("gene::serialize::read_header: not a gene checkpoint.");
+            }
+            if(r.get<std::uint32_t>() != byte_order_mark){
+                throw("gene::serialize::read_header: written with another byte order.");
+            }
+            if(r.get<std::uint32_t>() != format_version){
+                throw("gene::serialize::read_header: unsupported format version.");
+            }
+            if(r.get<std::uint32_t>() != static_cast<std::uint32_t>(kind)){
+                throw("gene::serialize::read_header: unexpected record kind.");
+            }
+            if(r.get<std::uint32_t>() != sizeof(ValueType)){
+                throw("gene::serialize::read_header: value type size mismatch.");
+            }
+            if(r.get<std::uint32_t>() != input_size || r.get<std::uint32_t>() != output_size){
+                throw("gene::serialize::read_header: input or output size mismatch.");
+            }
+        }
+
+        template<class ValueType, class RandomTermGen, class Primitives>
+        void write_tree(writer &w, tree::tree<ValueType, RandomTermGen, Primitives> const& t)
+        {
+            auto const flat = tree::flatten(t);
+            w.put(static_cast<std::uint64_t>(flat.size()));
+            for(auto const& n : flat.code()){
+                w.put(n.kind);
+                w.put(n.payload);
+            }
+            w.put(static_cast<std::uint64_t>(flat.constant_pool().size()));
+            w.put_array(flat.constant_pool().data(), flat.constant_pool().size());
+        }
+
+        // input_size == 0 skips the check of variable indices
+        template<class ValueType, class RandomTermGen, class Primitives>
+        tree::tree<ValueType, RandomTermGen, Primitives> read_tree(reader &r, std::size_t const input_size)
+        {
+            std::uint64_t const node_count = r.get<std::uint64_t>();
+            if(node_count == 0 || node_count > r.size() / sizeof(tree::flat_node)){
+                throw("gene::serialize::read_tree: invalid node count.");
+            }
+            std::vector<tree::flat_node> nodes(node_count);
+            for(auto &n : nodes){
+                n.kind = r.get<std::uint32_t>();
+                n.payload = r.get<std::uint32_t>();
+            }
+            std::uint64_t const constant_count = r.get<std::uint64_t>();
+            if(constant_count > node_count){
+                throw("gene::serialize::read_tree: invalid constant count.");
+            }
+            std::vector<ValueType> constants(constant_count);
+            r.get_array(constants.data(), constants.size());
+
+            // one complete prefix tree with valid payloads
+            std::size_t open = 1;
+            for(auto const& n : nodes){
+                if(open == 0
+                   || (n.kind == tree::constant_value && n.payload >= constant_count)
+                   || (n.kind == tree::knot_value && n.payload >= Primitives::size)
+                   || (n.kind == tree::variable_value && input_size != 0 && n.payload >= input_size)
+                   || n.kind > tree::variable_value){
+                    throw("gene::serialize::read_tree: malformed tree.");
+                }
+                open += tree::arity_of<Primitives>(n) - 1;
+            }
+            if(open != 0){
+                throw("gene::serialize::read_tree: malformed tree.");
+            }
+            return tree::unflatten(tree::flat_tree<ValueType, RandomTermGen, Primitives>(std::move(nodes), std::move(constants)));
+        }
+
+        template<class Individual>
+        void write_individual(writer &w, Individual const& ind)
+        {
+            auto const& trees = ind.get_trees();
+            w.put(static_cast<std::uint32_t>(trees.size()));
+            for(auto const& t : trees){
+                write_tree(w, t);
+            }
+            w.put(ind.fitness);
+            w.put(static_cast<std::uint8_t>(ind.needs_evaluation() || ind.is_rejected() ? 1 : 0));
+        }
+
+        template<class Individual>
+        void read_individual(reader &r, typename Individual::trees_type &trees,
+                             typename Individual::value_type &fitness, bool &stale)
+        {
+            if(r.get<std::uint32_t>() != trees.size()){
+                throw("gene::serialize::read_individual: tree count mismatch.");
+            }
+            for(auto &t : trees){
+                t = read_tree<typename Individual::value_type,
+                              typename Individual::random_term_generator,
+                              typename Individual::primitives_type>(r, Individual::input_size);
+            }
+            fitness = r.get<typename Individual::value_type>();
+            stale = r.get<std::uint8_t>() != 0;
+        }
+
+        template<class Individual>
+        Individual make_individual(typename Individual::trees_type const& trees,
+                                   typename Individual::value_type const fitness, bool const stale)
+        {
+            Individual retval(trees);
+            retval.set_fitness(fitness);
+            if(stale){
+                retval.invalidate_fitness();
+            }
+            return retval;
+        }
+
+        template<class Individuals>
+        void write_population_body(writer &w,
+                                   std::uint64_t const generation,
+                                   std::array<std::uint64_t, 4> const& engine_state,
+                                   Individuals const& individuals)
+        {
+            w.put(generation);
+            w.put(random::global_seed());
+            w.put_array(engine_state.data(), engine_state.size());
+            std::uint64_t const count = individuals.size();
+            w.put(count);
+            std::vector<std::uint64_t> offsets;
+            offsets.reserve(count);
+            for(std::uint64_t i = 0; i < count; ++i){
+                offsets.push_back(w.position());
+                write_individual(w, individuals[i]);
+                w.check();
+            }
+            std::uint64_t const index = w.position();
+            w.put_array(offsets.data(), offsets.size());
+            w.put(index);
+        }
+
+    } // namespace impl
+
+    // trees
+
+    template<class ValueType, class RandomTermGen, class Primitives>
+    void save(std::ostream &out, tree::tree<ValueType, RandomTermGen, Primitives> const& t)
+    {
+        impl::writer w(out);
+        impl::write_header<ValueType>(w, record::tree, 0, 0);
+        impl::write_tree(w, t);
+        w.check();
+    }
+
+    template< class ValueType,
+              class RandomTermGen = random_term::default_random_term<ValueType>,
+              class Primitives = tree::operators::default_primitives >
+    tree::tree<ValueType, RandomTermGen, Primitives> load_tree(char const* const data, std::size_t const size)
+    {
+        impl::reader r(data, size);
+        impl::read_header<ValueType>(r, record::tree, 0, 0);
+        return impl::read_tree<ValueType, RandomTermGen, Primitives>(r, 0);
+    }
+
+    // individuals
+
+    template<class ValueType, std::size_t InputSize, std::size_t ValueSize, class RandomTermGen, class Primitives>
+    void save(std::ostream &out, individual::individual<ValueType, InputSize, ValueSize, RandomTermGen, Primitives> const& ind)
+    {
+        impl::writer w(out);
+        impl::write_header<ValueType>(w, record::individual, InputSize, ValueSize);
+        impl::write_individual(w, ind);
+        w.check();
+    }
+
+    template<class Individual>
+    Individual load_individual(char const* const data, std::size_t const size)
+    {
+        typedef typename Individual::value_type value_type;
+        impl::reader r(data, size);
+        impl::read_header<value_type>(r, record::individual, Individual::input_size, Individual::output_size);
+        typename Individual::trees_type trees;
+        value_type fitness;
+        bool stale;
+        impl::read_individual<Individual>(r, trees, fitness, stale);
+        return impl::make_individual<Individual>(trees, fitness, stale);
+    }
+
+    // populations
+
+    // Streams a checkpoint of p, one individual at a time, together with the
+    // generation counter and the state of the calling thread's random engine.
+    template<class ValueType, std::size_t InputSize, std::size_t OutputSize, class RandomTermGen, class Primitives>
+    void save(std::ostream &out, population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives> const& p)
+    {
+        impl::writer w(out);
+        impl::write_header<ValueType>(w, record::population, InputSize, OutputSize);
+        impl::write_population_body(w, p.current_generation(), random::engine().state(), p);
+        w.check();
+    }
+
+    // Restores a checkpoint into p: its individuals, its generation counter,
+    // the global seed and the calling thread's random engine. Individuals are
+    // decoded in parallel on pool when one is given. Training data, caches
+    // and tables of p are left as they are.
+    template<class ValueType, std::size_t InputSize, std::size_t OutputSize, class RandomTermGen, class Primitives>
+    void load(char const* const data, std::size_t const size,
+              population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives> &p,
+              thread_pool* const pool = nullptr)
+    {
+        typedef typename population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives>::individual_type individual_type;
+
+        impl::reader r(data, size);
+        impl::read_header<ValueType>(r, record::population, InputSize, OutputSize);
+        std::uint64_t const generation = r.get<std::uint64_t>();
+        std::uint64_t const seed = r.get<std::uint64_t>();
+        std::array<std::uint64_t, 4> state;
+        r.get_array(state.data(), state.size());
+        std::uint64_t const count = r.get<std::uint64_t>();
+
+        impl::reader index_reader(data, size);
+        if(size < sizeof(std::uint64_t)){
+            throw("gene::serialize::load: truncated population.");
+        }
+        index_reader.seek(size - sizeof(std::uint64_t));
+        index_reader.seek(index_reader.get<std::uint64_t>());
+        if(count > size / sizeof(std::uint64_t)){
+            throw("gene::serialize::load: invalid individual count.");
+        }
+        std::vector<std::uint64_t> offsets(count);
+        index_reader.get_array(offsets.data(), offsets.size());
+
+        std::vector<typename individual_type::trees_type> trees(count);
+        std::vector<ValueType> fitness(count);
+        std::unique_ptr<bool[]> stale(new bool[count]);
+        auto decode = [&](std::size_t const i){
+            impl::reader ir(data, size);
+            ir.seek(offsets[i]);
+            if(auto const table = p.node_table()){
+                tree::scoped_table<ValueType> use(*table);
+                impl::read_individual<individual_type>(ir, trees[i], fitness[i], stale[i]);
+            }else{
+                impl::read_individual<individual_type>(ir, trees[i], fitness[i], stale[i]);
+            }
+        };
+        if(pool){
+            pool->parallel_for(0, count, decode, 64);
+        }else{
+            for(std::size_t i = 0; i < count; ++i){
+                decode(i);
+            }
+        }
+
+        std::vector<individual_type> individuals;
+        individuals.reserve(count);
+        for(std::size_t i = 0; i < count; ++i){
+            individuals.push_back(impl::make_individual<individual_type>(trees[i], fitness[i], stale[i]));
+        }
+        p.restore(std::move(individuals), generation);
+        random::global_seed() = seed;
+        random::engine().set_state(state);
+    }
+
+    template<class ValueType, std::size_t InputSize, std::size_t OutputSize, class RandomTermGen, class Primitives>
+    void load(std::istream &in, population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives> &p, thread_pool* const pool = nullptr)
+    {
+        std::vector<char> const bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        load(bytes.data(), bytes.size(), p, pool);
+    }
+
+    // Writes to path + ".tmp" and renames it over path, so a crash during
+    // a checkpoint leaves the previous one intact.
+    template<class ValueType, std::size_t InputSize, std::size_t OutputSize, class RandomTermGen, class Primitives>
+    void save_file(std::string const& path, population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives> const& p)
+    {
+        std::string const tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if(!out){
+                throw("gene::serialize::save_file: cannot open file.");
+            }
+            save(out, p);
+            out.flush();
+            if(!out){
+                throw("gene::serialize::save_file: write failed.");
+            }
+        }
+        if(std::rename(tmp.c_str(), path.c_str()) != 0){
+            throw("gene::serialize::save_file: rename failed.");
+        }
+    }
+
+    // Like save_file, but writes on another thread so evolution can go on.
+    // Individuals share their immutable nodes, so the snapshot taken here
+    // costs one pointer copy per tree rather than a deep copy.
+    template<class ValueType, std::size_t InputSize, std::size_t OutputSize, class RandomTermGen, class Primitives>
+    std::future<void> save_file_async(std::string const& path, population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives> const& p)
+    {
+        typedef typename population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives>::individual_type individual_type;
+
+        auto snapshot = std::make_shared<std::vector<individual_type>>();
+        snapshot->reserve(p.size());
+        for(std::size_t i = 0; i < p.size(); ++i){
+            snapshot->push_back(p[i]);
+        }
+        std::uint64_t const generation = p.current_generation();
+        auto const state = random::engine().state();
+        return std::async(std::launch::async, [=]{
+            std::string const tmp = path + ".tmp";
+            {
+                std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                if(!out){
+                    throw("gene::serialize::save_file_async: cannot open file.");
+                }
+                impl::writer w(out);
+                impl::write_header<ValueType>(w, record::population, InputSize, OutputSize);
+                impl::write_population_body(w, generation, state, *snapshot);
+                out.flush();
+                w.check();
+            }
+            if(std::rename(tmp.c_str(), path.c_str()) != 0){
+                throw("gene::serialize::save_file_async: rename failed.");
+            }
+        });
+    }
+
+    // Maps the checkpoint at path and restores it into p, see load.
+    template<class ValueType, std::size_t InputSize, std::size_t OutputSize, class RandomTermGen, class Primitives>
+    void load_file(std::string const& path, population<ValueType, InputSize, OutputSize, RandomTermGen, Primitives> &p, thread_pool* const pool = nullptr)
+    {
+        mapped_file const file(path);
+        load(file.data(), file.size(), p, pool);
+    }
+
+} // namespace serialize
+
+} // namespace gene
+
+#endif    // GENE_SERIALIZE_HPP_INCLUDED
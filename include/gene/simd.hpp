@@ -0,0 +1,256 @@
+#if !defined GENE_SIMD_HPP_INCLUDED
+#define      GENE_SIMD_HPP_INCLUDED
+
+#include <cstddef>
+#include <cmath>
+#include <type_traits>
+
+// The instruction set is chosen at compile time from the target flags
+// (e.g. -mavx2, -mavx512f or -march=native). Define GENE_NO_SIMD to force
+// the scalar loops.
+#if !defined GENE_NO_SIMD
+#  if defined __AVX512F__
+#    define GENE_SIMD_AVX512
+#  elif defined __AVX__
+#    define GENE_SIMD_AVX
+#  elif defined __SSE2__
+#    define GENE_SIMD_SSE2
+#  endif
+#endif
+
+#if defined GENE_SIMD_AVX512 || defined GENE_SIMD_AVX || defined GENE_SIMD_SSE2
+#  include <immintrin.h>
+#endif
+
+namespace gene {
+
+namespace simd {
+
+#if defined GENE_SIMD_AVX512
+    constexpr char const instruction_set[] = "avx512";
+#elif defined GENE_SIMD_AVX
+    constexpr char const instruction_set[] = "avx";
+#elif defined GENE_SIMD_SSE2
+    constexpr char const instruction_set[] = "sse2";
+#else
+    constexpr char const instruction_set[] = "scalar";
+#endif
+
+    namespace impl {
+
+        // pack<T> wraps the widest vector register available for T.
+        // The primary template means "no vector support", scalar loops are used.
+        template<class T>
+        struct pack{
+            static constexpr bool enabled = false;
+        };
+
+#if defined GENE_SIMD_AVX512
+        template<>
+        struct pack<double>{
+            static constexpr bool enabled = true;
+            static constexpr std::size_t width = 8;
+            typedef __m512d type;
+            static type load(double const* p) { return _mm512_loadu_pd(p); }
+            static void store(double* p, type a) { _mm512_storeu_pd(p, a); }
+            static type add(type a, type b) { return _mm512_add_pd(a, b); }
+            static type sub(type a, type b) { return _mm512_sub_pd(a, b); }
+            static type mul(type a, type b) { return _mm512_mul_pd(a, b); }
+            static type div(type a, type b) { return _mm512_div_pd(a, b); }
+            static type abs(type a) { return _mm512_abs_pd(a); }
+            static type sqrt(type a) { return _mm512_sqrt_pd(a); }
+        };
+
+        template<>
+        struct pack<float>{
+            static constexpr bool enabled = true;
+            static constexpr std::size_t width = 16;
+            typedef __m512 type;
+            static type load(float const* p) { return _mm512_loadu_ps(p); }
+            static void store(float* p, type a) { _mm512_storeu_ps(p, a); }
+            static type add(type a, type b) { return _mm512_add_ps(a, b); }
+            static type sub(type a, type b) { return _mm512_sub_ps(a, b); }
+            static type mul(type a, type b) { return _mm512_mul_ps(a, b); }
+            static type div(type a, type b) { return _mm512_div_ps(a, b); }
+            static type abs(type a) { return _mm512_abs_ps(a); }
+            static type sqrt(type a) { return _mm512_sqrt_ps(a); }
+        };
+#elif defined GENE_SIMD_AVX
+        template<>
+        struct pack<double>{
+            static constexpr bool enabled = true;
+            static constexpr std::size_t width = 4;
+            typedef __m256d type;
+            static type load(double const* p) { return _mm256_loadu_pd(p); }
+            static void store(double* p, type a) { _mm256_storeu_pd(p, a); }
+            static type add(type a, type b) { return _mm256_add_pd(a, b); }
+            static type sub(type a, type b) { return _mm256_sub_pd(a, b); }
+            static type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+            static type div(type a, type b) { return _mm256_div_pd(a, b); }
+            static type abs(type a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+            static type sqrt(type a) { return _mm256_sqrt_pd(a); }
+        };
+
+        template<>
+        struct pack<float>{
+            static constexpr bool enabled = true;
+            static constexpr std::size_t width = 8;
+            typedef __m256 type;
+            static type load(float const* p) { return _mm256_loadu_ps(p); }
+            static void store(float* p, type a) { _mm256_storeu_ps(p, a); }
+            static type add(type a, type b) { return _mm256_add_ps(a, b); }
+            static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+            static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+            static type div(type a, type b) { return _mm256_div_ps(a, b); }
+            static type abs(type a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+            static type sqrt(type a) { return _mm256_sqrt_ps(a); }
+        };
+#elif defined GENE_SIMD_SSE2
+        template<>
+        struct pack<double>{
+            static constexpr bool enabled = true;
+            static constexpr std::size_t width = 2;
+            typedef __m128d type;
+            static type load(double const* p) { return _mm_loadu_pd(p); }
+            static void store(double* p, type a) { _mm_storeu_pd(p, a); }
+            static type add(type a, type b) { return _mm_add_pd(a, b); }
+            static type sub(type a, type b) { return _mm_sub_pd(a, b); }
+            static type mul(type a, type b) { return _mm_mul_pd(a, b); }
+            static type div(type a, type b) { return _mm_div_pd(a, b); }
+            static type abs(type a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+            static type sqrt(type a) { return _mm_sqrt_pd(a); }
+        };
+
+        template<>
+        struct pack<float>{
+            static constexpr bool enabled = true;
+            static constexpr std::size_t width = 4;
+            typedef __m128 type;
+            static type load(float const* p) { return _mm_loadu_ps(p); }
+            static void store(float* p, type a) { _mm_storeu_ps(p, a); }
+            static type add(type a, type b) { return _mm_add_ps(a, b); }
+            static type sub(type a, type b) { return _mm_sub_ps(a, b); }
+            static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+            static type div(type a, type b) { return _mm_div_ps(a, b); }
+            static type abs(type a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+            static type sqrt(type a) { return _mm_sqrt_ps(a); }
+        };
+#endif
+
+        struct add_op{
+            template<class T> T operator()(T const a, T const b) const { return a + b; }
+            template<class P> typename P::type operator()(P, typename P::type a, typename P::type b) const { return P::add(a, b); }
+        };
+
+        struct sub_op{
+            template<class T> T operator()(T const a, T const b) const { return a - b; }
+            template<class P> typename P::type operator()(P, typename P::type a, typename P::type b) const { return P::sub(a, b); }
+        };
+
+        struct mul_op{
+            template<class T> T operator()(T const a, T const b) const { return a * b; }
+            template<class P> typename P::type operator()(P, typename P::type a, typename P::type b) const { return P::mul(a, b); }
+        };
+
+        struct div_op{
+            template<class T> T operator()(T const a, T const b) const { return a / b; }
+            template<class P> typename P::type operator()(P, typename P::type a, typename P::type b) const { return P::div(a, b); }
+        };
+
+        struct abs_op{
+            template<class T> T operator()(T const a) const { return std::abs(a); }
+            template<class P> typename P::type operator()(P, typename P::type a) const { return P::abs(a); }
+        };
+
+        struct sqrt_op{
+            template<class T> T operator()(T const a) const { return std::sqrt(a); }
+            template<class P> typename P::type operator()(P, typename P::type a) const { return P::sqrt(a); }
+        };
+
+        template<class T, class Op>
+        void binary(T* out, T const* a, T const* b, std::size_t const n, Op op, std::false_type)
+        {
+            for(std::size_t i = 0; i < n; ++i){
+                out[i] = op(a[i], b[i]);
+            }
+        }
+
+        template<class T, class Op>
+        void binary(T* out, T const* a, T const* b, std::size_t const n, Op op, std::true_type)
+        {
+            typedef pack<T> P;
+            std::size_t i = 0;
+            for(; i + P::width <= n; i += P::width){
+                P::store(out + i, op(P(), P::load(a + i), P::load(b + i)));
+            }
+            binary(out + i, a + i, b + i, n - i, op, std::false_type());
+        }
+
+        template<class T, class Op>
+        void unary(T* out, T const* a, std::size_t const n, Op op, std::false_type)
+        {
+            for(std::size_t i = 0; i < n; ++i){
+                out[i] = op(a[i]);
+            }
+        }
+
+        template<class T, class Op>
+        void unary(T* out, T const* a, std::size_t const n, Op op, std::true_type)
+        {
+            typedef pack<T> P;
+            std::size_t i = 0;
+            for(; i + P::width <= n; i += P::width){
+                P::store(out + i, op(P(), P::load(a + i)));
+            }
+            unary(out + i, a + i, n - i, op, std::false_type());
+        }
+
+        template<class T>
+        using vectorized = std::integral_constant<bool, pack<T>::enabled>;
+
+    } // namespace impl
+
+    // Element-wise kernels over contiguous ranges of n elements.
+    // out may alias any of the inputs.
+
+    template<class T>
+    inline void add(T* out, T const* a, T const* b, std::size_t const n)
+    {
+        impl::binary(out, a, b, n, impl::add_op(), impl::vectorized<T>());
+    }
+
+    template<class T>
+    inline void sub(T* out, T const* a, T const* b, std::size_t const n)
+    {
+        impl::binary(out, a, b, n, impl::sub_op(), impl::vectorized<T>());
+    }
+
+    template<class T>
+    inline void mul(T* out, T const* a, T const* b, std::size_t const n)
+    {
+        impl::binary(out, a, b, n, impl::mul_op(), impl::vectorized<T>());
+    }
+
+    template<class T>
+    inline void div(T* out, T const* a, T const* b, std::size_t const n)
+    {
+        impl::binary(out, a, b, n, impl::div_op(), impl::vectorized<T>());
+    }
+
+    template<class T>
+    inline void abs(T* out, T const* a, std::size_t const n)
+    {
+        impl::unary(out, a, n, impl::abs_op(), impl::vectorized<T>());
+    }
+
+    template<class T>
+    inline void sqrt(T* out, T const* a, std::size_t const n)
+    {
+        impl::unary(out, a, n, impl::sqrt_op(), impl::vectorized<T>());
+    }
+
+} // namespace simd
+
+} // namespace gene
+
+#endif    // GENE_SIMD_HPP_INCLUDED
@@ -0,0 +1,169 @@
+#if !defined GENE_SIMPLIFY_HPP_INCLUDED
+#define      GENE_SIMPLIFY_HPP_INCLUDED
+
+#include "node.hpp"
+#include "operators.hpp"
+#include "hashcons.hpp"
+#include "tree.hpp"
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+#include <boost/variant.hpp>
+
+namespace gene {
+
+namespace tree {
+
+    namespace impl {
+
+        template<class ValueType>
+        bool same_subtree(std::shared_ptr<node<ValueType>> const& lhs, std::shared_ptr<node<ValueType>> const& rhs)
+        {
+            if(lhs == rhs){
+                return true;
+            }
+            if(lhs->which() != rhs->which() || node_hash(*lhs) != node_hash(*rhs)){
+                return false;
+            }
+            switch(lhs->which()){
+            case constant_value: return boost::get<ValueType>(*lhs) == boost::get<ValueType>(*rhs);
+            case variable_value: return boost::get<Variable>(*lhs) == boost::get<Variable>(*rhs);
+            case knot_value:
+                {
+                    auto const& l = boost::get<knot<ValueType>>(*lhs);
+                    auto const& r = boost::get<knot<ValueType>>(*rhs);
+                    if(l.op != r.op){
+                        return false;
+                    }
+                    for(std::size_t i = 0; i < l.children.size(); ++i){
+                        if(!same_subtree(l.children[i], r.children[i])){
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+            default: throw("gene::tree::impl::same_subtree: invalid node value.");
+            }
+        }
+
+        // Order of the operands of commutative operators: constants first,
+        // then variables by index, then knots by hash.
+        template<class ValueType>
+        bool canonical_less(std::shared_ptr<node<ValueType>> const& lhs, std::shared_ptr<node<ValueType>> const& rhs)
+        {
+            static int const rank[] = { 0, 2, 1 };   // constant, knot, variable
+            if(lhs->which() != rhs->which()){
+                return rank[lhs->which()] < rank[rhs->which()];
+            }
+            switch(lhs->which()){
+            case constant_value: return boost::get<ValueType>(*lhs) < boost::get<ValueType>(*rhs);
+            case variable_value: return boost::get<Variable>(*lhs) < boost::get<Variable>(*rhs);
+            default: return node_hash(*lhs) < node_hash(*rhs);
+            }
+        }
+
+        template<class ValueType>
+        bool is_constant(std::shared_ptr<node<ValueType>> const& n, ValueType const v)
+        {
+            return n->which() == constant_value && boost::get<ValueType>(*n) == v;
+        }
+
+        // false when Operator is not in Primitives
+        template<class Operator, class Primitives, class ValueType>
+        bool is_op(std::shared_ptr<node<ValueType>> const& n)
+        {
+            return n->which() == knot_value
+                && boost::get<knot<ValueType>>(*n).op == Primitives::template index_of<Operator>::value;
+        }
+
+        // Simplifies the children first, then the node itself. Unchanged
+        // subtrees are returned as they are, so they stay shared.
+        template<class Primitives, class ValueType>
+        std::shared_ptr<node<ValueType>> simplify_impl(std::shared_ptr<node<ValueType>> const& n)
+        {
+            namespace ops = operators;
+
+            if(n->which() != knot_value){
+                return n;
+            }
+            auto const& original = boost::get<knot<ValueType>>(*n);
+            auto children = original.children;
+            bool changed = false;
+            bool all_constant = true;
+            for(auto &child : children){
+                auto simplified = simplify_impl<Primitives>(child);
+                changed = changed || simplified != child;
+                child = std::move(simplified);
+                all_constant = all_constant && child->which() == constant_value;
+            }
+
+            if(all_constant){
+                ValueType args[Primitives::max_arity];
+                for(std::size_t i = 0; i < children.size(); ++i){
+                    args[i] = boost::get<ValueType>(*children[i]);
+                }
+                return make_node<ValueType>(Primitives::template apply<ValueType>(original.op, args));
+            }
+
+            ValueType const zero = ValueType(0), one = ValueType(1);
+            if(is_op<ops::plus, Primitives>(n)){
+                if(is_constant(children[1], zero)) return children[0];
+                if(is_constant(children[0], zero)) return children[1];
+            }else if(is_op<ops::minus, Primitives>(n)){
+                if(is_constant(children[1], zero)) return children[0];
+                if(same_subtree(children[0], children[1])) return make_node<ValueType>(zero);
+            }else if(is_op<ops::mult, Primitives>(n)){
+                if(is_constant(children[0], zero) || is_constant(children[1], zero)) return make_node<ValueType>(zero);
+                if(is_constant(children[1], one)) return children[0];
+                if(is_constant(children[0], one)) return children[1];
+            }else if(is_op<ops::divide, Primitives>(n) || is_op<ops::protected_divide, Primitives>(n)){
+                if(is_constant(children[1], one)) return children[0];
+            }else if(is_op<ops::abs, Primitives>(n)){
+                if(is_op<ops::abs, Primitives>(children[0]) || is_op<ops::sqrt, Primitives>(children[0])) return children[0];
+            }
+
+            if((is_op<ops::plus, Primitives>(n) || is_op<ops::mult, Primitives>(n)) && canonical_less(children[1], children[0])){
+                std::swap(children[0], children[1]);
+                changed = true;
+            }
+
+            if(!changed){
+                return n;
+            }
+            knot<ValueType> knot_node(original.op, original.arity);
+            knot_node.children = std::move(children);
+            return make_node<ValueType>(std::move(knot_node));
+        }
+
+    } // namespace impl
+
+    // Rewrites t into a smaller equivalent tree:
+    //   constant folding          ( 3 + 4 ) -> 7, sqrt( 4 ) -> 2
+    //   identities                x + 0, x - 0, x * 1, x / 1 -> x
+    //   annihilators              x * 0 -> 0, x - x -> 0
+    //   idempotence               abs( abs( x ) ), abs( sqrt( x ) ) -> the argument
+    //   commutative operands      ( x1 + x0 ) -> ( x0 + x1 ), constants first
+    // Folding uses the same arithmetic as evaluation; the annihilators
+    // assume x is finite. Rules for operators missing from the primitive
+    // set are skipped. Returns the number of nodes removed.
+    template<class ValueType, class RandomTermGen, class Primitives>
+    std::size_t simplify(tree<ValueType, RandomTermGen, Primitives> &t)
+    {
+        auto const root = t.root_node();
+        auto const simplified = impl::simplify_impl<Primitives>(root);
+        if(simplified == root){
+            return 0;
+        }
+        std::size_t const before = node_size(*root);
+        t = tree<ValueType, RandomTermGen, Primitives>(simplified);
+        return before - node_size(*simplified);
+    }
+
+} // namespace tree
+
+} // namespace gene
+
+#endif    // GENE_SIMPLIFY_HPP_INCLUDED
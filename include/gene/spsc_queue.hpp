@@ -0,0 +1,108 @@
+#if !defined GENE_SPSC_QUEUE_HPP_INCLUDED
+#define      GENE_SPSC_QUEUE_HPP_INCLUDED
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+
+namespace gene {
+
+    // Bounded lock-free queue for exactly one producer thread and one
+    // consumer thread. The capacity is rounded up to a power of two.
+    template<class T>
+    class spsc_queue{
+    private:
+        typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type slot_type;
+        static constexpr std::size_t cache_line = 64;
+
+        std::size_t mask;
+        std::unique_ptr<slot_type[]> slots;
+        char pad0[cache_line];
+        std::atomic<std::size_t> head;  // next slot to read, advanced by the consumer
+        char pad1[cache_line - sizeof(std::atomic<std::size_t>)];
+        std::atomic<std::size_t> tail;  // next slot to write, advanced by the producer
+        char pad2[cache_line - sizeof(std::atomic<std::size_t>)];
+
+        static std::size_t round_up(std::size_t const n)
+        {
+            std::size_t retval = 1;
+            while(retval < n){
+                retval <<= 1;
+            }
+            return retval;
+        }
+
+        T* slot(std::size_t const i)
+        {
+            return reinterpret_cast<T*>(&slots[i & mask]);
+        }
+
+    public:
+        explicit spsc_queue(std::size_t const capacity)
+            : mask(round_up(capacity) - 1), slots(new slot_type[mask + 1]), head(0), tail(0)
+        {}
+
+        spsc_queue(spsc_queue const&) = delete;
+        spsc_queue& operator=(spsc_queue const&) = delete;
+
+        ~spsc_queue()
+        {
+            for(std::size_t i = head.load(std::memory_order_relaxed), end = tail.load(std::memory_order_relaxed); i != end; ++i){
+                slot(i)->~T();
+            }
+        }
+
+        std::size_t capacity() const
+        {
+            return mask + 1;
+        }
+
+        // producer side; false if the queue is full
+        bool try_push(T value)
+        {
+            std::size_t const t = tail.load(std::memory_order_relaxed);
+            if(t - head.load(std::memory_order_acquire) > mask){
+                return false;
+            }
+            new (slot(t)) T(std::move(value));
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer side; false if the queue is empty
+        bool try_pop(T &value)
+        {
+            std::size_t const h = head.load(std::memory_order_relaxed);
+            if(h == tail.load(std::memory_order_acquire)){
+                return false;
+            }
+            T* const p = slot(h);
+            value = std::move(*p);
+            p->~T();
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer side; moves everything available to the back of out
+        std::size_t pop_all(std::vector<T> &out)
+        {
+            std::size_t h = head.load(std::memory_order_relaxed);
+            std::size_t const end = tail.load(std::memory_order_acquire);
+            std::size_t const retval = end - h;
+            for(; h != end; ++h){
+                T* const p = slot(h);
+                out.push_back(std::move(*p));
+                p->~T();
+                head.store(h + 1, std::memory_order_release);
+            }
+            return retval;
+        }
+    };
+
+} // namespace gene
+
+#endif    // GENE_SPSC_QUEUE_HPP_INCLUDED
@@ -0,0 +1,190 @@
+#if !defined GENE_THREAD_POOL_HPP_INCLUDED
+#define      GENE_THREAD_POOL_HPP_INCLUDED
+
+#include "config.hpp"
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <cstddef>
+
+namespace gene {
+
+    // Fixed-size pool of workers with one task deque each.
+    // A worker takes tasks from the back of its own deque and, when that is
+    // empty, steals from the front of the others, so uneven tasks balance out.
+    class thread_pool{
+    private:
+        typedef std::function<void()> task_type;
+
+        struct task_queue{
+            std::mutex mutex;
+            std::deque<task_type> tasks;
+        };
+
+        std::vector<std::unique_ptr<task_queue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::atomic<std::size_t> queued;
+        bool stopping;
+
+        bool pop(std::size_t const self, task_type &task)
+        {
+            auto &q = *queues[self];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if(q.tasks.empty()){
+                return false;
+            }
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            --queued;
+            return true;
+        }
+
+        bool steal(std::size_t const self, task_type &task)
+        {
+            for(std::size_t i = 1; i <= queues.size(); ++i){
+                auto &q = *queues[(self + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if(!q.tasks.empty()){
+                    task = std::move(q.tasks.front());
+                    q.tasks.pop_front();
+                    --queued;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(std::size_t const self)
+        {
+            task_type task;
+            for(;;){
+                if(pop(self, task) || steal(self, task)){
+                    task();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]{ return stopping || queued != 0; });
+                if(stopping && queued == 0){
+                    return;
+                }
+            }
+        }
+
+        void push(std::size_t const index, task_type task)
+        {
+            auto &q = *queues[index % queues.size()];
+            {
+                std::lock_guard<std::mutex> lock(q.mutex);
+                q.tasks.push_back(std::move(task));
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            ++queued;
+        }
+
+    public:
+        // thread_count == 0 uses std::thread::hardware_concurrency()
+        explicit thread_pool(std::size_t thread_count = config::thread_count)
+            : queues(), workers(), mutex(), wake(), queued(0), stopping(false)
+        {
+            if(thread_count == 0){
+                thread_count = std::max(1u, std::thread::hardware_concurrency());
+            }
+            for(std::size_t i = 0; i < thread_count; ++i){
+                queues.emplace_back(new task_queue);
+            }
+            for(std::size_t i = 0; i < thread_count; ++i){
+                workers.emplace_back([this, i]{ this->work(i); });
+            }
+        }
+
+        thread_pool(thread_pool const&) = delete;
+        thread_pool& operator=(thread_pool const&) = delete;
+
+        ~thread_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for(auto &w : workers){
+                w.join();
+            }
+        }
+
+        std::size_t size() const
+        {
+            return workers.size();
+        }
+
+        // Calls f(i) for every i in [first, last), grain indices per task,
+        // and returns when all calls have finished. The calling thread helps.
+        // The first exception thrown by f is rethrown here.
+        template<class F>
+        void parallel_for(std::size_t const first, std::size_t const last, F f, std::size_t grain = 1)
+        {
+            if(first >= last){
+                return;
+            }
+            grain = std::max<std::size_t>(grain, 1);
+
+            struct state_type{
+                std::atomic<std::size_t> remaining;
+                std::mutex mutex;
+                std::condition_variable done;
+                std::exception_ptr error;
+            };
+            auto state = std::make_shared<state_type>();
+            state->remaining = (last - first + grain - 1) / grain;
+
+            std::size_t index = 0;
+            for(std::size_t begin = first; begin < last; begin += grain, ++index){
+                std::size_t const end = std::min(begin + grain, last);
+                push(index, [state, begin, end, f]{
+                    try{
+                        for(std::size_t i = begin; i < end; ++i){
+                            f(i);
+                        }
+                    }catch(...){
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        if(!state->error){
+                            state->error = std::current_exception();
+                        }
+                    }
+                    if(--state->remaining == 0){
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        state->done.notify_all();
+                    }
+                });
+            }
+            wake.notify_all();
+
+            task_type task;
+            while(state->remaining != 0){
+                if(steal(0, task)){
+                    task();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(state->mutex);
+                state->done.wait(lock, [&]{ return state->remaining == 0; });
+            }
+
+            if(state->error){
+                std::rethrow_exception(state->error);
+            }
+        }
+    };
+
+} // namespace gene
+
+#endif    // GENE_THREAD_POOL_HPP_INCLUDED
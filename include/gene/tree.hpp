@@ -3,7 +3,9 @@
 
 #include "config.hpp"
 #include "util.hpp"
+#include "random.hpp"
 #include "node.hpp"
+#include "hashcons.hpp"
 #include "operators.hpp"
 #include "random_term.hpp"
 
@@ -11,37 +13,47 @@
 #include <vector>
 #include <algorithm>
 #include <numeric>
-#include <random>
 #include <memory>
 #include <cstddef>
 #include <type_traits>
 
 #include <boost/lexical_cast.hpp>
-#include <boost/variant/static_visitor.hpp>
 
 namespace gene {
 
 namespace tree {
 
-    template<class ValueType, class RandomTermGenerator = random_term::default_random_term<ValueType>>
+    // Path from the root to a node: nodes[0] is the root and nodes[i+1] is
+    // child indices[i] of nodes[i].
+    template<class ValueType>
+    struct location{
+        std::vector<std::shared_ptr<node<ValueType>>> nodes;
+        std::vector<std::size_t> indices;
+
+        std::shared_ptr<node<ValueType>> const& target() const
+        {
+            return nodes.back();
+        }
+    };
+
+    // Nodes are never modified once built: replace(), and so mutation and
+    // crossover, copy the path from the changed node up to the root. Copies
+    // of a tree therefore share their nodes safely and copying is O(1).
+    template< class ValueType,
+              class RandomTermGenerator = random_term::default_random_term<ValueType>,
+              class Primitives = operators::default_primitives >
     class tree{
+        static_assert(Primitives::max_arity <= max_knot_arity, "gene::tree::tree: an operator has too many operands.");
+
     public:
         typedef std::shared_ptr<node<ValueType>> node_ptr_type;
+        typedef location<ValueType> location_type;
+        typedef Primitives primitives_type;
 
     private:
         std::shared_ptr<node<ValueType>> root;
 
     private:
-        struct operator_to_string : boost::static_visitor<std::string>{
-            std::vector<std::string> const& args;
-            operator_to_string(std::vector<std::string> const& args_) : args(args_) {}
-            template<class Operator>
-            std::string operator()(Operator const& op) const
-            {
-                return op.to_string(args);
-            }
-        };
-
         std::string expression_impl(node_ptr_type const node_ptr) const
         {
             if(node_ptr->which() == constant_value){
@@ -55,7 +67,7 @@ namespace tree {
                         [&](std::shared_ptr<node<ValueType>> n) {
                             return this->expression_impl(n);
                         });
-                return boost::apply_visitor(operator_to_string(arg_strs), knot_node.op);
+                return Primitives::to_string(knot_node.op, arg_strs);
             }else if(node_ptr->which() == variable_value){
                 // when node has variable terminal
                 return variable_name(boost::get<Variable>(*node_ptr));
@@ -64,14 +76,6 @@ namespace tree {
             }
         }
 
-        struct operator_symbol : boost::static_visitor<std::string>{
-            template<class Operator>
-            std::string operator()(Operator) const
-            {
-                return Operator::symbol;
-            }
-        };
-
         std::string indent(int const level) const
         {
             return std::string(level * config::indent_width, ' ');
@@ -84,7 +88,7 @@ namespace tree {
                     + boost::lexical_cast<std::string>(boost::get<ValueType>(*node_ptr)) + '\n';
             } else if(node_ptr->which() == knot_value){
                 auto const& knot_node = boost::get<knot<ValueType>>(*node_ptr);
-                std::string retval = indent(level) + boost::apply_visitor(operator_symbol(), knot_node.op) + ":\n";
+                std::string retval = indent(level) + Primitives::symbol(knot_node.op) + ":\n";
                 return std::accumulate( knot_node.children.begin(),
                                         knot_node.children.end(),
                                         retval,
@@ -101,42 +105,18 @@ namespace tree {
         }
 
 
-        struct apply_operator : boost::static_visitor<ValueType> {
-            std::vector<ValueType> const& args;
-            apply_operator(std::vector<ValueType> const& args_) : args(args_) {}
-
-            template<class Operator>
-            typename std::enable_if<Operator::arity==2, ValueType>::type
-            operator()(Operator) const
-            {
-                if(args.size() != Operator::arity){
-                    throw("apply_operator: invalid number of arguments");
-                }
-                return Operator()(args[0], args[1]);
-            }
-
-            template<class Operator>
-            typename std::enable_if<Operator::arity==1, ValueType>::type
-            operator()(Operator) const
-            {
-                if(args.size() != Operator::arity){
-                    throw("apply_operator: invalid number of arguments");
-                }
-                return Operator()(args[0]);
-            }
-        };
-
         template<std::size_t InputSize>
         ValueType value_impl(node_ptr_type const node_ptr, std::array<ValueType, InputSize> const& variable_values) const
         {
             if(node_ptr->which() == constant_value){
                 return boost::get<ValueType>(*node_ptr);
             }else if(node_ptr->which() == knot_value){
-                std::vector<ValueType> args;
-                for(auto const& child : boost::get<knot<ValueType>>(*node_ptr).children){
-                    args.push_back(value_impl(child, variable_values));
+                auto const& knot_node = boost::get<knot<ValueType>>(*node_ptr);
+                ValueType args[Primitives::max_arity];
+                for(std::size_t i = 0; i < knot_node.arity; ++i){
+                    args[i] = value_impl(knot_node.children[i], variable_values);
                 }
-                return boost::apply_visitor(apply_operator(args), boost::get<knot<ValueType>>(*node_ptr).op);
+                return Primitives::template apply<ValueType>(knot_node.op, args);
             }else if(node_ptr->which() == variable_value){
                 return variable_values[boost::get<Variable>(*node_ptr)];
             }else{
@@ -144,36 +124,22 @@ namespace tree {
             }
         }
 
-        std::size_t depth_impl(node_ptr_type const node_ptr) const
-        {
-            auto which = node_ptr->which();
-            if(which == knot_value){
-                auto const& children = boost::get<knot<ValueType>>(*node_ptr).children;
-                return std::accumulate(children.begin(), children.end(), 0,
-                                         [this](std::size_t acc, node_ptr_type const& rhs)
-                                         {
-                                            auto depth = this->depth_impl(rhs);
-                                            return acc < depth ? depth : acc;
-                                         }) + 1;
-            }else if(which == constant_value || which == variable_value){
-                return 0;
-            }else{
-                throw("gene::tree::depth_impl: invalid node value.");
-            }
-        }
-
-        node_ptr_type anywhere_impl(node_ptr_type node, std::size_t const depth) const
+        void anywhere_impl(location_type &loc, std::size_t const depth) const
         {
             double const probability_to_decide_here = 1.0 / depth;
-            std::bernoulli_distribution return_here(probability_to_decide_here);
-            if(return_here(config::random_engine)){
-                return node;
+            if(random::bernoulli(probability_to_decide_here)){
+                return;
             }else{
+                auto const& node = loc.target();
                 auto which = node->which();
                 if(which == knot_value){
-                    return anywhere_impl(util::sample(boost::get<knot<ValueType>>(*node).children), depth);
+                    auto const& children = boost::get<knot<ValueType>>(*node).children;
+                    auto const index = random::uniform_index(children.size());
+                    loc.indices.push_back(index);
+                    loc.nodes.push_back(children[index]);
+                    anywhere_impl(loc, depth);
                 }else if(which == constant_value || which == variable_value){
-                    return node;
+                    return;
                 }else{
                     throw("gene::tree::anywhere_impl: invalid node value.");
                 }
@@ -200,71 +166,187 @@ namespace tree {
             return value_impl(root, variable_values);
         }
 
+        // O(1): every knot keeps the depth and size of its subtree
         std::size_t depth() const
         {
-            return depth_impl(root);
+            return node_depth(*root);
+        }
+
+        std::size_t size() const
+        {
+            return node_size(*root);
         }
 
         node_ptr_type anywhere() const
         {
-            return anywhere_impl(root, depth());
+            return locate_anywhere().target();
+        }
+
+        // path to a random node, deeper nodes being less likely, O(depth)
+        location_type locate_anywhere() const
+        {
+            location_type loc;
+            loc.nodes.push_back(root);
+            anywhere_impl(loc, depth());
+            return loc;
         }
 
-        
+        // path to the index-th node in prefix order, O(depth)
+        location_type locate_at(std::size_t index) const
+        {
+            if(index >= size()){
+                throw("gene::tree::locate_at: index out of range.");
+            }
+            location_type loc;
+            loc.nodes.push_back(root);
+            while(index != 0){
+                auto const& children = boost::get<knot<ValueType>>(*loc.target()).children;
+                --index;
+                for(std::size_t i = 0; i < children.size(); ++i){
+                    std::size_t const child_size = node_size(*children[i]);
+                    if(index < child_size){
+                        loc.indices.push_back(i);
+                        loc.nodes.push_back(children[i]);
+                        break;
+                    }
+                    index -= child_size;
+                }
+            }
+            return loc;
+        }
+
+        // path to a node chosen uniformly among all nodes, O(depth)
+        location_type locate_uniform() const
+        {
+            return locate_at(random::uniform_index(size()));
+        }
+
+        // the node selection used by mutation and crossover,
+        // see config::uniform_node_selection
+        location_type locate_random() const
+        {
+            return config::uniform_node_selection ? locate_uniform() : locate_anywhere();
+        }
+
+        // depth and size the tree would have after replace(loc, subtree), O(depth)
+        std::size_t depth_if_replaced(location_type const& loc, node_ptr_type const& subtree) const
+        {
+            std::size_t d = node_depth(*subtree);
+            for(std::size_t i = loc.indices.size(); i-- > 0;){
+                auto const& children = boost::get<knot<ValueType>>(*loc.nodes[i]).children;
+                std::size_t deepest = 0;
+                for(std::size_t c = 0; c < children.size(); ++c){
+                    deepest = std::max(deepest, c == loc.indices[i] ? d : node_depth(*children[c]));
+                }
+                d = deepest + 1;
+            }
+            return d;
+        }
+
+        std::size_t size_if_replaced(location_type const& loc, node_ptr_type const& subtree) const
+        {
+            return size() - node_size(*loc.target()) + node_size(*subtree);
+        }
+
+        // whether replace(loc, subtree) stays within config::max_tree_depth
+        // and config::max_tree_size
+        bool fits(location_type const& loc, node_ptr_type const& subtree) const
+        {
+            return (config::max_tree_depth == 0 || depth_if_replaced(loc, subtree) <= config::max_tree_depth)
+                && (config::max_tree_size == 0 || size_if_replaced(loc, subtree) <= config::max_tree_size);
+        }
+
+        // Replaces the node at loc with subtree. The ancestors of that node
+        // are copied, nothing reachable from other trees is modified.
+        void replace(location_type const& loc, node_ptr_type subtree)
+        {
+            for(std::size_t i = loc.indices.size(); i-- > 0;){
+                knot<ValueType> parent = boost::get<knot<ValueType>>(*loc.nodes[i]);
+                parent.children[loc.indices[i]] = std::move(subtree);
+                subtree = make_node<ValueType>(std::move(parent));
+            }
+            root = std::move(subtree);
+        }
+
+        // structural hash, O(1)
+        std::size_t hash() const
+        {
+            return node_hash(*root);
+        }
+
+        node_ptr_type root_node() const
+        {
+            return root;
+        }
     };
 
     namespace impl {
 
-        template<class ValueType, std::size_t InputSize, class Generator>
+        template<class ValueType, std::size_t InputSize, class Generator, class Primitives>
         std::shared_ptr<node<ValueType>> random_partial_tree(std::size_t const max_depth, std::size_t const depth)
         {
             if(depth==max_depth){
-                return std::make_shared<node<ValueType>>(Generator::generate_term());
+                return make_node<ValueType>(Generator::generate_term());
             }
 
             double const probability_to_make_operator = (max_depth - 1.0) / max_depth;
-            std::bernoulli_distribution has_operator(probability_to_make_operator);
-            if(has_operator(config::random_engine)){
-                knot<ValueType> knot_node(operators::random_op());
+            if(random::bernoulli(probability_to_make_operator)){
+                auto const op = Primitives::random_index();
+                knot<ValueType> knot_node(op, Primitives::arity(op));
                 typename knot<ValueType>::children_type children_;
                 for(std::size_t i=0; i < knot_node.arity; ++i){
-                    children_.push_back(random_partial_tree<ValueType, InputSize, Generator>(max_depth, depth+1));
+                    children_.push_back(random_partial_tree<ValueType, InputSize, Generator, Primitives>(max_depth, depth+1));
                 }
                 knot_node.children = children_;
-                return std::make_shared<node<ValueType>>(knot_node);
+                return make_node<ValueType>(knot_node);
             }else{
-                std::bernoulli_distribution has_constant(0.50);
-                if(has_constant(config::random_engine)){
-                    return std::make_shared<node<ValueType>>(Generator::generate_term());
+                if(random::bernoulli(0.50)){
+                    return make_node<ValueType>(Generator::generate_term());
                 }else{
-                    std::uniform_int_distribution<std::size_t> variable_number(0, InputSize-1);
-                    return std::make_shared<node<ValueType>>(variable_number(config::random_engine));
+                    return make_node<ValueType>(static_cast<Variable>(random::uniform_index(InputSize)));
                 }
             }
         }
 
     } // namespace impl
 
-    template<class ValueType, std::size_t InputSize, class RandomTermGenerator = random_term::default_random_term<ValueType>>
-    inline tree<ValueType, RandomTermGenerator> generate_random(std::size_t const max_depth)
+    template< class ValueType,
+              std::size_t InputSize,
+              class RandomTermGenerator = random_term::default_random_term<ValueType>,
+              class Primitives = operators::default_primitives >
+    inline tree<ValueType, RandomTermGenerator, Primitives> generate_random(std::size_t const max_depth)
     {
-        return {impl::random_partial_tree<ValueType, InputSize, RandomTermGenerator>(max_depth, 0)};
+        return {impl::random_partial_tree<ValueType, InputSize, RandomTermGenerator, Primitives>(max_depth, 0)};
     }
 
-    template<std::size_t InputSize, class ValueType, class RandomTermGen>
-    void mutation(tree<ValueType, RandomTermGen> &t)
+    // Mutation and crossover retry with other nodes when the result would
+    // break config::max_tree_depth or config::max_tree_size, and leave the
+    // trees unchanged if no attempt fits.
+    template<std::size_t InputSize, class ValueType, class RandomTermGen, class Primitives>
+    void mutation(tree<ValueType, RandomTermGen, Primitives> &t)
     {
-        auto anywhere_ptr = t.anywhere();
-        auto new_partial_tree = impl::random_partial_tree<ValueType, InputSize, RandomTermGen>(config::random_tree_depth, 0);
-        *anywhere_ptr = *new_partial_tree;
+        for(std::size_t attempt = 0; attempt < config::breeding_attempts; ++attempt){
+            auto const loc = t.locate_random();
+            auto subtree = impl::random_partial_tree<ValueType, InputSize, RandomTermGen, Primitives>(config::random_tree_depth, 0);
+            if(t.fits(loc, subtree)){
+                t.replace(loc, std::move(subtree));
+                return;
+            }
+        }
     }
 
-    template<class ValueType, class RandomTermGen>
-    void crossover(tree<ValueType, RandomTermGen> &lhs, tree<ValueType, RandomTermGen> &rhs)
+    template<class ValueType, class RandomTermGen, class Primitives>
+    void crossover(tree<ValueType, RandomTermGen, Primitives> &lhs, tree<ValueType, RandomTermGen, Primitives> &rhs)
     {
-        auto lhs_anywhere = lhs.anywhere();
-        auto rhs_anywhere = rhs.anywhere();
-        lhs_anywhere->swap(*rhs_anywhere);
+        for(std::size_t attempt = 0; attempt < config::breeding_attempts; ++attempt){
+            auto const lhs_anywhere = lhs.locate_random();
+            auto const rhs_anywhere = rhs.locate_random();
+            if(lhs.fits(lhs_anywhere, rhs_anywhere.target()) && rhs.fits(rhs_anywhere, lhs_anywhere.target())){
+                lhs.replace(lhs_anywhere, rhs_anywhere.target());
+                rhs.replace(rhs_anywhere, lhs_anywhere.target());
+                return;
+            }
+        }
     }
 
 } // namespace tree
@@ -2,8 +2,8 @@
 #define      GENE_UTIL_HPP_INCLUDED
 
 #include "config.hpp"
+#include "random.hpp"
 
-#include <random>
 #include <vector>
 
 namespace gene {
@@ -35,8 +35,7 @@ namespace util {
     template<class T>
     T sample(std::vector<T> const& v)
     {
-        std::uniform_int_distribution<std::size_t> random_index(0, v.size()-1);
-        return v[random_index(config::random_engine)];
+        return v[random::uniform_index(v.size())];
     }
 } // namespace util
 } // namespace gene